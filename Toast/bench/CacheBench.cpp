@@ -0,0 +1,147 @@
+/*
+* Compares the cache containers: std::map keyed by decimal snowflake strings (the old caches) against SnowflakeMap.
+* Measures insert, lookup (hits and misses), erase and memory, using DiscordObjects::User as the element.
+*
+* usage: CacheBench [elements] [lookups]
+*/
+
+#include <map>
+#include <new>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "SnowflakeMap.hpp"
+#include "data_structures/User.hpp"
+
+/* every allocation in the process is counted, so memory use is the difference across building a container */
+static size_t allocated_bytes = 0;
+
+void *operator new(size_t size) {
+	void *p = std::malloc(size + sizeof(size_t));
+	if (!p) throw std::bad_alloc();
+	*static_cast<size_t *>(p) = size;
+	allocated_bytes += size;
+	return static_cast<size_t *>(p) + 1;
+}
+
+// kept out of line, otherwise gcc thinks free() is given memory from operator new
+static void __attribute__((noinline)) release(size_t *base) {
+	allocated_bytes -= *base;
+	std::free(base);
+}
+
+void operator delete(void *p) noexcept {
+	if (!p) return;
+	release(static_cast<size_t *>(p) - 1);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	operator delete(p);
+}
+
+/* snowflakes as Discord makes them: ms since 2015 << 22 | worker << 17 | increment */
+static std::vector<uint64_t> make_snowflakes(size_t n, std::mt19937_64 &rng) {
+	const uint64_t first_ms = 50000000000ull; // ~2016
+	std::vector<uint64_t> ids;
+	ids.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t ms = first_ms + rng() % 60000000000ull;
+		ids.push_back(ms << 22 | (rng() % 32) << 17 | (rng() % 4096));
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	std::shuffle(ids.begin(), ids.end(), rng);
+	return ids;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start, size_t ops) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+}
+
+struct Result {
+	double insert_ns, hit_ns, miss_ns, erase_ns;
+	size_t bytes;
+};
+
+static void print_result(const char *name, const Result &r, size_t n) {
+	std::printf("%-28s insert %7.1f ns  hit %7.1f ns  miss %7.1f ns  erase %7.1f ns  memory %8.1f KB (%5.1f B/element)\n",
+		name, r.insert_ns, r.hit_ns, r.miss_ns, r.erase_ns, r.bytes / 1024.0, static_cast<double>(r.bytes) / n);
+}
+
+int main(int argc, char *argv[]) {
+	size_t element_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+	size_t lookup_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000000;
+
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> ids = make_snowflakes(element_count * 2, rng);
+	std::vector<uint64_t> present(ids.begin(), ids.begin() + element_count);
+	std::vector<uint64_t> absent(ids.begin() + element_count, ids.end());
+
+	// lookups come in as strings from the gateway, so both containers start from one
+	std::vector<std::string> present_str, absent_str;
+	for (uint64_t id : present) present_str.push_back(std::to_string(id));
+	for (uint64_t id : absent) absent_str.push_back(std::to_string(id));
+
+	std::vector<size_t> order(lookup_count);
+	for (size_t &i : order) i = rng() % present.size();
+
+	size_t checksum = 0;
+	std::printf("%zu elements, %zu lookups, sizeof(User) = %zu\n", present.size(), lookup_count, sizeof(DiscordObjects::User));
+
+	{
+		Result r;
+		size_t before = allocated_bytes;
+		std::map<std::string, DiscordObjects::User> map;
+
+		auto start = std::chrono::steady_clock::now();
+		for (const std::string &id : present_str) map.emplace(id, DiscordObjects::User());
+		r.insert_ns = elapsed_ns(start, present_str.size());
+		r.bytes = allocated_bytes - before;
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i : order) checksum += map.find(present_str[i])->second.bot;
+		r.hit_ns = elapsed_ns(start, order.size());
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i : order) checksum += map.count(absent_str[i % absent_str.size()]);
+		r.miss_ns = elapsed_ns(start, order.size());
+
+		start = std::chrono::steady_clock::now();
+		for (const std::string &id : present_str) map.erase(id);
+		r.erase_ns = elapsed_ns(start, present_str.size());
+
+		print_result("std::map<std::string, User>", r, present.size());
+	}
+	{
+		Result r;
+		size_t before = allocated_bytes;
+		SnowflakeMap<DiscordObjects::User> map;
+
+		auto start = std::chrono::steady_clock::now();
+		for (const std::string &id : present_str) map.emplace(to_snowflake(id));
+		r.insert_ns = elapsed_ns(start, present_str.size());
+		r.bytes = allocated_bytes - before;
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i : order) checksum += map.find(to_snowflake(present_str[i]))->second.bot;
+		r.hit_ns = elapsed_ns(start, order.size());
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i : order) checksum += map.count(to_snowflake(absent_str[i % absent_str.size()]));
+		r.miss_ns = elapsed_ns(start, order.size());
+
+		start = std::chrono::steady_clock::now();
+		for (const std::string &id : present_str) map.erase(to_snowflake(id));
+		r.erase_ns = elapsed_ns(start, present_str.size());
+
+		print_result("SnowflakeMap<User>", r, present.size());
+	}
+
+	// keeps the lookups from being optimised away
+	return checksum == 1 ? 1 : 0;
+}
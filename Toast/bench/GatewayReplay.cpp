@@ -0,0 +1,156 @@
+/*
+* Replays a gateway recording (see GatewayRecorder, gateway.record_file in config.json) into GatewayHandler with no network connection,
+* to measure cache ingest and dispatch performance.
+*
+* usage: GatewayReplay <recording> [--realtime] [--repeat n] [--commands]
+*   --realtime  keep the original gaps between frames, otherwise frames are replayed as fast as possible
+*   --repeat    replay the recording n times (the caches are not cleared in between)
+*   --commands  also replay messages which start with a command. These make REST calls (to rest.base_url in config.json), so are skipped by default.
+*/
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <curl/curl.h>
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+#include "GatewayHandler.hpp"
+#include "GatewayRecorder.hpp"
+#include "LatencyHistogram.hpp"
+#include "InternedString.hpp"
+#include "BotConfig.hpp"
+#include "DiscordAPI.hpp"
+#include "http/HTTP.hpp"
+#include "js/CommandHelper.hpp"
+
+static long peak_memory_kb() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <recording> [--realtime] [--repeat n] [--commands]" << std::endl;
+		return 1;
+	}
+
+	bool realtime = false;
+	bool commands = false;
+	int repeat = 1;
+	for (int i = 2; i < argc; i++) {
+		if (std::strcmp(argv[i], "--realtime") == 0) {
+			realtime = true;
+		}
+		else if (std::strcmp(argv[i], "--commands") == 0) {
+			commands = true;
+		}
+		else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = std::max(1, std::atoi(argv[++i]));
+		}
+		else {
+			std::cerr << "Unknown argument " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	// Only dispatches are replayed, the rest (hello, heartbeat ACKs etc) would try to talk to the gateway
+	std::vector<GatewayRecorder::Frame> frames;
+	{
+		GatewayRecorder::Reader reader(argv[1]);
+		if (!reader.is_open()) {
+			std::cerr << argv[1] << " is not a gateway recording (version " << GatewayRecorder::version << ")" << std::endl;
+			return 1;
+		}
+
+		GatewayRecorder::Frame frame;
+		std::string event_name;
+		while (reader.next(frame)) {
+			if (!GatewayHandler::peek_event_name(frame.payload, event_name)) continue;
+			if (!commands && event_name == "MESSAGE_CREATE" && frame.payload.find("\"content\":\"`") != std::string::npos) continue;
+
+			frames.push_back(frame);
+		}
+	}
+
+	std::cout << "Loaded " << frames.size() << " dispatch frames, peak memory " << peak_memory_kb() << " KB" << std::endl;
+	if (frames.empty()) {
+		return 0;
+	}
+
+	// same start up and shut down order as Toast.cpp. Commands' requests go to api_base_url, e.g. a MockDiscord server.
+	BotConfig config;
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	HTTP::start(config.rest_max_in_flight);
+	DiscordAPI::set_base_url(config.api_base_url);
+	DiscordAPI::set_coalesce_window(std::chrono::milliseconds(config.message_coalesce_ms));
+
+	v8::V8::InitializeICUDefaultLocation(argv[0]);
+	v8::V8::InitializeExternalStartupData(argv[0]);
+	v8::Platform* platform = v8::platform::CreateDefaultPlatform();
+	v8::V8::InitializePlatform(platform);
+	v8::V8::Initialize();
+
+	CommandHelper::init();
+
+	int exit_code = 0;
+	{
+		GatewayHandler gh(config, nullptr, 0);
+		client cli;
+		websocketpp::connection_hdl hdl;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < repeat; i++) {
+			auto pass_start = std::chrono::steady_clock::now();
+
+			for (auto &frame : frames) {
+				if (realtime) {
+					std::this_thread::sleep_until(pass_start + std::chrono::microseconds(frame.time_us - frames.front().time_us));
+				}
+
+				try {
+					// copied, as the frames are replayed again
+					gh.handle_data(std::string(frame.payload), cli, hdl);
+				}
+				catch (const std::exception &e) {
+					std::cerr << "Frame failed: " << e.what() << std::endl;
+					exit_code = 2;
+				}
+			}
+		}
+		// handle_data only queues dispatches on the pipeline
+		gh.wait_idle();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		unsigned long total = frames.size() * repeat;
+		std::cout << "Replayed " << total << " events in " << seconds << " s (" << total / seconds << " events/s)" << std::endl;
+		std::cout << "Per event handling time:" << std::endl;
+		for (auto &e : gh.get_event_stats()) {
+			if (e.second.count() > 0) {
+				std::cout << "  " << e.first << ": " << e.second.to_string("us") << std::endl;
+			}
+		}
+		std::cout << "Peak memory " << peak_memory_kb() << " KB" << std::endl;
+		std::cout << "Interned strings: " << InternedString::stats_string() << std::endl;
+
+		gh.shutdown();
+	}
+
+	v8::V8::Dispose();
+	v8::V8::ShutdownPlatform();
+	delete platform;
+
+	DiscordAPI::flush_messages();
+	HTTP::cleanup();
+	curl_global_cleanup();
+
+	return exit_code;
+}
@@ -0,0 +1,895 @@
+/*
+* A stand in for Discord, so the whole bot (ClientConnection, GatewayHandler, DiscordAPI, TriviaGame, ...) can be run
+* and load tested locally. Serves the gateway and the REST endpoints the bot uses on one port, over TLS, for
+* synthesised guilds, channels and members, and sends MESSAGE_CREATEs at a steady rate.
+*
+* usage: MockDiscord [--port n] [--host name] [--guilds n] [--members n] [--channels n] [--online f]
+*                    [--message-rate n] [--command text]... [--command-share f] [--latency ms] [--rate-limit n]
+*                    [--global-limit n] [--heartbeat-interval ms] [--cert file --key file]
+*   --port                for the gateway (wss) and REST (https), default 8443
+*   --host                the gateway url given out by GET /gateway is wss://<host>:<port>, default localhost
+*   --guilds              guilds in total, split between the shards the way Discord does, default 100
+*   --members             members of each guild, default 100
+*   --channels            text channels in each guild, default 3
+*   --online              share of members who are online. Only these are in a large guild's GUILD_CREATE, default 0.1
+*   --message-rate        MESSAGE_CREATEs a second on each shard's connection, default 10
+*   --command             a command to send, may be given more than once. Defaults to `info
+*   --command-share       share of messages which are commands, sent by the guild's owner (who has the Admin role), default 0.1
+*   --latency             ms added to every REST response, default 0
+*   --rate-limit          messages a channel can be sent each second before a 429, 0 for no limit, default 5
+*   --global-limit        REST requests each second before a global 429, 0 for no limit, default 50
+*   --heartbeat-interval  ms, sent in HELLO, default 41250
+*   --cert, --key         PEM certificate and key to use. Otherwise a self-signed certificate for the host and 127.0.0.1
+*                         is made and written to MockDiscord.crt and MockDiscord.key
+*
+* The bot is pointed at it with rest.base_url ("https://localhost:8443/api") and api_cert_file ("MockDiscord.crt") in
+* config.json, and gateway.compress set to false as transport compression isn't supported. Sessions can be resumed,
+* but no events are replayed. websocketpp closes the connection after each HTTP response, so every REST request
+* opens a new one.
+*/
+
+#include <map>
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/server.hpp>
+
+#include "json/json.hpp"
+
+using json = nlohmann::json;
+
+typedef websocketpp::server<websocketpp::config::asio_tls> server;
+typedef websocketpp::lib::shared_ptr<boost::asio::ssl::context> context_ptr;
+
+struct Options {
+	int port = 8443;
+	std::string host = "localhost";
+	size_t guilds = 100;
+	size_t members = 100;
+	size_t channels = 3;
+	double online = 0.1;
+	double message_rate = 10;
+	std::vector<std::string> commands;
+	double command_share = 0.1;
+	long latency = 0;
+	int rate_limit = 5;
+	int global_limit = 50;
+	int heartbeat_interval = 41250;
+	std::string cert_file;
+	std::string key_file;
+};
+
+/*
+* Ids are snowflakes of (counter << 22), each kind with its own range of counters, so an id is mapped back to its
+* guild without a lookup. Guild g's counter is g + 1, so the guilds are spread evenly over the shards.
+*/
+namespace Ids {
+	const uint64_t channel_base = 1ull << 30;
+	const uint64_t role_base = 1ull << 34;
+	const uint64_t user_base = 1ull << 36;
+	const uint64_t message_base = 1ull << 40;
+	const uint64_t bot_user = (1ull << 41) - 1;
+
+	std::string snowflake(uint64_t counter) {
+		return std::to_string(counter << 22);
+	}
+
+	// counter of the id, 0 if it isn't one
+	uint64_t counter(const std::string &id) {
+		char *end;
+		unsigned long long value = std::strtoull(id.c_str(), &end, 10);
+		return id.empty() || *end ? 0 : value >> 22;
+	}
+}
+
+// writes a self-signed certificate, valid for a year, for the host and 127.0.0.1
+static bool make_certificate(const std::string &host, const std::string &cert_file, const std::string &key_file) {
+	EVP_PKEY *key = nullptr;
+	EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+	bool made = key_ctx && EVP_PKEY_keygen_init(key_ctx) > 0 && EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, 2048) > 0 && EVP_PKEY_keygen(key_ctx, &key) > 0;
+	EVP_PKEY_CTX_free(key_ctx);
+	if (!made) {
+		return false;
+	}
+
+	X509 *cert = X509_new();
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 365 * 24 * 3600L);
+	X509_set_pubkey(cert, key);
+
+	X509_NAME *name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>(host.c_str()), -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+
+	// it is its own CA, so curl can be given it as the CA file
+	X509V3_CTX v3;
+	X509V3_set_ctx_nodb(&v3);
+	X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+	std::string alt_names = "DNS:" + host + ",IP:127.0.0.1";
+	std::pair<int, std::string> extensions[] = {
+		{ NID_basic_constraints, "critical,CA:TRUE" },
+		{ NID_subject_alt_name, alt_names }
+	};
+	for (auto &e : extensions) {
+		X509_EXTENSION *extension = X509V3_EXT_conf_nid(nullptr, &v3, e.first, const_cast<char *>(e.second.c_str()));
+		made = made && extension && X509_add_ext(cert, extension, -1);
+		X509_EXTENSION_free(extension);
+	}
+	made = made && X509_sign(cert, key, EVP_sha256()) > 0;
+
+	FILE *cert_out = made ? std::fopen(cert_file.c_str(), "w") : nullptr;
+	FILE *key_out = cert_out ? std::fopen(key_file.c_str(), "w") : nullptr;
+	made = key_out && PEM_write_X509(cert_out, cert) && PEM_write_PrivateKey(key_out, key, nullptr, nullptr, 0, nullptr, nullptr);
+	if (cert_out) std::fclose(cert_out);
+	if (key_out) std::fclose(key_out);
+
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	return made;
+}
+
+class MockDiscord {
+public:
+	MockDiscord(const Options &options);
+
+	void run();
+
+private:
+	struct Session {
+		std::string id;
+		bool identified = false;
+		int shard_id = 0;
+		int shard_count = 1;
+		int large_threshold = 50;
+		int seq = 0;
+
+		// MESSAGE_CREATEs due but not sent yet, sent in batches on a short timer
+		double messages_owed = 0;
+		std::chrono::steady_clock::time_point last_messages;
+		server::timer_ptr message_timer;
+	};
+
+	struct Response {
+		int code = 200;
+		json body = json::object();
+		std::map<std::string, std::string> headers;
+	};
+
+	// requests in the current second, for a channel or globally
+	struct Window {
+		int used = 0;
+		std::chrono::steady_clock::time_point reset;
+	};
+
+	/* the synthesised guilds */
+	json user(size_t guild, size_t member) const;
+	json member(size_t guild, size_t member) const;
+	json guild_create(size_t guild, int large_threshold) const;
+	// the guild an id belongs to, or false
+	bool guild_index(const std::string &guild_id, size_t &guild) const;
+	bool channel_index(const std::string &channel_id, size_t &guild) const;
+
+	/* gateway */
+	void on_open(websocketpp::connection_hdl hdl);
+	void on_close(websocketpp::connection_hdl hdl);
+	void on_message(websocketpp::connection_hdl hdl, server::message_ptr message);
+	void on_identify(websocketpp::connection_hdl hdl, Session &session, const json &data);
+	void on_resume(websocketpp::connection_hdl hdl, Session &session, const json &data);
+	void on_request_guild_members(websocketpp::connection_hdl hdl, Session &session, const json &data);
+	void send(websocketpp::connection_hdl hdl, const std::string &payload);
+	void close(websocketpp::connection_hdl hdl, websocketpp::close::status::value code, const std::string &reason);
+	// in the order Discord sends them, so the bot can peek at the event name
+	void send_dispatch(websocketpp::connection_hdl hdl, Session &session, const std::string &name, const json &data);
+	void schedule_messages(websocketpp::connection_hdl hdl);
+	void send_messages(websocketpp::connection_hdl hdl);
+
+	/* REST */
+	void on_http(websocketpp::connection_hdl hdl);
+	Response rest(const std::string &method, const std::string &path, const std::string &authorization, const std::string &body);
+	// counts the request against the window, false if it is already used up
+	bool take(Window &window, int limit, Response &response, bool global);
+
+	void schedule_stats();
+	context_ptr on_tls_init(websocketpp::connection_hdl hdl);
+
+	const Options options;
+	server endpoint;
+	std::mt19937 rng;
+
+	std::map<websocketpp::connection_hdl, Session, std::owner_less<websocketpp::connection_hdl>> sessions;
+	// <session id, session> of closed connections, for resuming
+	std::unordered_map<std::string, Session> closed_sessions;
+	unsigned long sessions_created;
+	uint64_t next_message;
+
+	std::unordered_map<uint64_t, Window> channel_windows;
+	Window global_window;
+
+	struct Stats {
+		unsigned long identifies = 0;
+		unsigned long resumes = 0;
+		unsigned long heartbeats = 0;
+		unsigned long dispatches = 0;
+		unsigned long messages = 0;
+		unsigned long rest_requests = 0;
+		unsigned long messages_posted = 0;
+		unsigned long message_lines = 0;
+		unsigned long member_lookups = 0;
+		unsigned long rate_limited = 0;
+		unsigned long global_rate_limited = 0;
+	} stats, last_stats;
+	server::timer_ptr stats_timer;
+};
+
+MockDiscord::MockDiscord(const Options &options) : options(options), rng(std::random_device()()) {
+	sessions_created = 0;
+	next_message = 0;
+
+	endpoint.clear_access_channels(websocketpp::log::alevel::all);
+	endpoint.set_error_channels(websocketpp::log::elevel::warn | websocketpp::log::elevel::rerror | websocketpp::log::elevel::fatal);
+	endpoint.init_asio();
+	endpoint.set_reuse_addr(true);
+
+	using websocketpp::lib::placeholders::_1;
+	using websocketpp::lib::placeholders::_2;
+	endpoint.set_tls_init_handler(websocketpp::lib::bind(&MockDiscord::on_tls_init, this, _1));
+	endpoint.set_open_handler(websocketpp::lib::bind(&MockDiscord::on_open, this, _1));
+	endpoint.set_close_handler(websocketpp::lib::bind(&MockDiscord::on_close, this, _1));
+	endpoint.set_message_handler(websocketpp::lib::bind(&MockDiscord::on_message, this, _1, _2));
+	endpoint.set_http_handler(websocketpp::lib::bind(&MockDiscord::on_http, this, _1));
+}
+
+void MockDiscord::run() {
+	endpoint.listen(options.port);
+	endpoint.start_accept();
+
+	std::cout << "Serving " << options.guilds << " guild(s) of " << options.members << " member(s) on port " << options.port
+		<< " (gateway wss://" << options.host << ":" << options.port << ", REST https://" << options.host << ":" << options.port << "/api)" << std::endl;
+
+	schedule_stats();
+	endpoint.run();
+}
+
+context_ptr MockDiscord::on_tls_init(websocketpp::connection_hdl) {
+	context_ptr ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23);
+
+	try {
+		ctx->set_options(boost::asio::ssl::context::default_workarounds |
+			boost::asio::ssl::context::no_sslv2 |
+			boost::asio::ssl::context::no_sslv3 |
+			boost::asio::ssl::context::single_dh_use);
+		ctx->use_certificate_chain_file(options.cert_file);
+		ctx->use_private_key_file(options.key_file, boost::asio::ssl::context::pem);
+	}
+	catch (std::exception &e) {
+		std::cerr << "TLS setup failed: " << e.what() << std::endl;
+	}
+	return ctx;
+}
+
+/* the synthesised guilds */
+
+json MockDiscord::user(size_t guild, size_t member) const {
+	std::string id = Ids::snowflake(Ids::user_base + guild * options.members + member);
+	char discriminator[5];
+	std::snprintf(discriminator, sizeof discriminator, "%04zu", (guild * options.members + member) % 10000);
+
+	return {
+		{ "id", id },
+		{ "username", "user " + std::to_string(guild) + "-" + std::to_string(member) },
+		{ "discriminator", discriminator },
+		{ "avatar", nullptr },
+		{ "bot", false }
+	};
+}
+
+json MockDiscord::member(size_t guild, size_t member) const {
+	json roles = json::array();
+	if (member == 0) {
+		roles.push_back(Ids::snowflake(Ids::role_base + guild));
+	}
+
+	return {
+		{ "user", user(guild, member) },
+		{ "nick", nullptr },
+		{ "roles", roles },
+		{ "joined_at", "2017-01-01T00:00:00.000000+00:00" },
+		{ "deaf", false },
+		{ "mute", false }
+	};
+}
+
+json MockDiscord::guild_create(size_t guild, int large_threshold) const {
+	std::string id = Ids::snowflake(guild + 1);
+	bool large = options.members > static_cast<size_t>(large_threshold);
+	size_t online = static_cast<size_t>(std::ceil(options.members * options.online));
+
+	json channels = json::array();
+	for (size_t c = 0; c < options.channels; c++) {
+		channels.push_back({
+			{ "id", Ids::snowflake(Ids::channel_base + guild * options.channels + c) },
+			{ "name", "channel-" + std::to_string(c) },
+			{ "type", "text" },
+			{ "position", c },
+			{ "topic", nullptr },
+			{ "last_message_id", nullptr }
+		});
+	}
+
+	json roles = {
+		{ { "id", id }, { "name", "@everyone" }, { "permissions", 104324161 }, { "position", 0 }, { "color", 0 }, { "hoist", false }, { "managed", false }, { "mentionable", false } },
+		{ { "id", Ids::snowflake(Ids::role_base + guild) }, { "name", "Admin" }, { "permissions", 8 }, { "position", 1 }, { "color", 0 }, { "hoist", false }, { "managed", false }, { "mentionable", false } }
+	};
+
+	// large guilds only come with their online members
+	json members = json::array();
+	json presences = json::array();
+	for (size_t m = 0; m < options.members; m++) {
+		if (m < online) {
+			presences.push_back({ { "user", { { "id", Ids::snowflake(Ids::user_base + guild * options.members + m) } } }, { "status", "online" }, { "game", nullptr } });
+		}
+		else if (large) {
+			break;
+		}
+		members.push_back(member(guild, m));
+	}
+
+	return {
+		{ "id", id },
+		{ "name", "guild " + std::to_string(guild) },
+		{ "icon", nullptr },
+		{ "owner_id", Ids::snowflake(Ids::user_base + guild * options.members) },
+		{ "region", "mock" },
+		{ "afk_channel_id", nullptr },
+		{ "afk_timeout", 300 },
+		{ "verification_level", 0 },
+		{ "large", large },
+		{ "unavailable", false },
+		{ "member_count", options.members },
+		{ "joined_at", "2017-01-01T00:00:00.000000+00:00" },
+		{ "channels", channels },
+		{ "roles", roles },
+		{ "members", members },
+		{ "presences", presences },
+		{ "voice_states", json::array() }
+	};
+}
+
+bool MockDiscord::guild_index(const std::string &guild_id, size_t &guild) const {
+	uint64_t counter = Ids::counter(guild_id);
+	if (counter == 0 || counter > options.guilds) {
+		return false;
+	}
+	guild = counter - 1;
+	return true;
+}
+
+bool MockDiscord::channel_index(const std::string &channel_id, size_t &guild) const {
+	uint64_t counter = Ids::counter(channel_id);
+	if (counter < Ids::channel_base || counter >= Ids::channel_base + options.guilds * options.channels) {
+		return false;
+	}
+	guild = (counter - Ids::channel_base) / options.channels;
+	return true;
+}
+
+/* gateway */
+
+void MockDiscord::send(websocketpp::connection_hdl hdl, const std::string &payload) {
+	websocketpp::lib::error_code ec;
+	endpoint.send(hdl, payload, websocketpp::frame::opcode::text, ec);
+}
+
+void MockDiscord::close(websocketpp::connection_hdl hdl, websocketpp::close::status::value code, const std::string &reason) {
+	websocketpp::lib::error_code ec;
+	endpoint.close(hdl, code, reason, ec);
+}
+
+void MockDiscord::send_dispatch(websocketpp::connection_hdl hdl, Session &session, const std::string &name, const json &data) {
+	send(hdl, "{\"t\":\"" + name + "\",\"s\":" + std::to_string(++session.seq) + ",\"op\":0,\"d\":" + data.dump() + "}");
+	stats.dispatches++;
+}
+
+void MockDiscord::on_open(websocketpp::connection_hdl hdl) {
+	sessions[hdl] = Session();
+
+	json hello = {
+		{ "t", nullptr },
+		{ "s", nullptr },
+		{ "op", 10 },
+		{ "d", {
+			{ "heartbeat_interval", options.heartbeat_interval },
+			{ "_trace", { "mock-gateway" } }
+		} }
+	};
+	send(hdl, hello.dump());
+}
+
+void MockDiscord::on_close(websocketpp::connection_hdl hdl) {
+	auto it = sessions.find(hdl);
+	if (it == sessions.end()) {
+		return;
+	}
+
+	Session &session = it->second;
+	if (session.message_timer) {
+		session.message_timer->cancel();
+		session.message_timer.reset();
+	}
+	if (session.identified) {
+		std::cout << "Shard " << session.shard_id << " disconnected at seq " << session.seq << std::endl;
+		closed_sessions[session.id] = session;
+	}
+	sessions.erase(it);
+}
+
+void MockDiscord::on_message(websocketpp::connection_hdl hdl, server::message_ptr message) {
+	auto it = sessions.find(hdl);
+	if (it == sessions.end()) {
+		return;
+	}
+
+	json payload;
+	try {
+		payload = json::parse(message->get_payload());
+	}
+	catch (const std::exception &) {
+		close(hdl, 4002, "Error while decoding payload.");
+		return;
+	}
+
+	const json &data = payload.count("d") ? payload["d"] : json();
+	switch (payload.value("op", -1)) {
+	case 1: // Heartbeat
+		stats.heartbeats++;
+		send(hdl, "{\"t\":null,\"s\":null,\"op\":11,\"d\":null}");
+		break;
+	case 2: // Identify
+		on_identify(hdl, it->second, data);
+		break;
+	case 6: // Resume
+		on_resume(hdl, it->second, data);
+		break;
+	case 8: // Request Guild Members
+		on_request_guild_members(hdl, it->second, data);
+		break;
+	case 3: // Status Update
+	case 4: // Voice State Update
+		break;
+	default:
+		close(hdl, 4001, "Unknown opcode.");
+		break;
+	}
+}
+
+void MockDiscord::on_identify(websocketpp::connection_hdl hdl, Session &session, const json &data) {
+	if (session.identified) {
+		close(hdl, 4005, "Already authenticated.");
+		return;
+	}
+
+	std::vector<int> shard = data.value("shard", std::vector<int> { 0, 1 });
+	if (shard.size() != 2 || shard[1] < 1 || shard[0] < 0 || shard[0] >= shard[1]) {
+		close(hdl, 4010, "Invalid shard.");
+		return;
+	}
+
+	session.id = "mock-session-" + std::to_string(++sessions_created);
+	session.identified = true;
+	session.shard_id = shard[0];
+	session.shard_count = shard[1];
+	session.large_threshold = std::max(50, std::min(250, data.value("large_threshold", 50)));
+	stats.identifies++;
+
+	// a guild's shard is (guild_id >> 22) % shard_count
+	std::vector<size_t> guilds;
+	for (size_t g = 0; g < options.guilds; g++) {
+		if ((g + 1) % session.shard_count == static_cast<size_t>(session.shard_id)) {
+			guilds.push_back(g);
+		}
+	}
+
+	json unavailable_guilds = json::array();
+	for (size_t g : guilds) {
+		unavailable_guilds.push_back({ { "id", Ids::snowflake(g + 1) }, { "unavailable", true } });
+	}
+	json ready = {
+		{ "v", 6 },
+		{ "user", {
+			{ "id", Ids::snowflake(Ids::bot_user) },
+			{ "username", "Toast" },
+			{ "discriminator", "0001" },
+			{ "avatar", nullptr },
+			{ "bot", true },
+			{ "mfa_enabled", false }
+		} },
+		{ "session_id", session.id },
+		{ "guilds", unavailable_guilds },
+		{ "private_channels", json::array() },
+		{ "_trace", { "mock-gateway" } }
+	};
+	send_dispatch(hdl, session, "READY", ready);
+
+	for (size_t g : guilds) {
+		send_dispatch(hdl, session, "GUILD_CREATE", guild_create(g, session.large_threshold));
+	}
+
+	std::cout << "Shard " << session.shard_id << "/" << session.shard_count << " identified, sent " << guilds.size() << " guild(s)" << std::endl;
+	session.last_messages = std::chrono::steady_clock::now();
+	schedule_messages(hdl);
+}
+
+void MockDiscord::on_resume(websocketpp::connection_hdl hdl, Session &session, const json &data) {
+	auto it = closed_sessions.find(data.value("session_id", ""));
+	if (session.identified || it == closed_sessions.end()) {
+		send(hdl, "{\"t\":null,\"s\":null,\"op\":9,\"d\":false}");
+		return;
+	}
+
+	session = it->second;
+	closed_sessions.erase(it);
+	stats.resumes++;
+
+	send_dispatch(hdl, session, "RESUMED", { { "_trace", { "mock-gateway" } } });
+	std::cout << "Shard " << session.shard_id << " resumed at seq " << session.seq << std::endl;
+	session.last_messages = std::chrono::steady_clock::now();
+	schedule_messages(hdl);
+}
+
+void MockDiscord::on_request_guild_members(websocketpp::connection_hdl hdl, Session &session, const json &data) {
+	// only every member is ever asked for, so query and limit are ignored
+	size_t guild;
+	std::string guild_id = data.value("guild_id", "");
+	if (!session.identified || !guild_index(guild_id, guild)) {
+		return;
+	}
+
+	const size_t chunk_size = 1000;
+	for (size_t start = 0; start < options.members; start += chunk_size) {
+		json members = json::array();
+		for (size_t m = start; m < std::min(options.members, start + chunk_size); m++) {
+			members.push_back(member(guild, m));
+		}
+		send_dispatch(hdl, session, "GUILD_MEMBERS_CHUNK", { { "guild_id", guild_id }, { "members", members } });
+	}
+}
+
+void MockDiscord::schedule_messages(websocketpp::connection_hdl hdl) {
+	auto it = sessions.find(hdl);
+	if (it == sessions.end() || options.message_rate <= 0 || options.guilds == 0 || options.channels == 0 || options.members == 0) {
+		return;
+	}
+
+	it->second.message_timer = endpoint.set_timer(10, [this, hdl](const websocketpp::lib::error_code &ec) {
+		if (!ec) {
+			send_messages(hdl);
+		}
+	});
+}
+
+void MockDiscord::send_messages(websocketpp::connection_hdl hdl) {
+	auto it = sessions.find(hdl);
+	if (it == sessions.end()) {
+		return;
+	}
+	Session &session = it->second;
+
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - session.last_messages).count();
+	session.last_messages = now;
+	// at most a second's worth at once, if the timer was held up
+	session.messages_owed = std::min(session.messages_owed + elapsed * options.message_rate, std::max(1.0, options.message_rate));
+
+	// the shard's guilds are those whose counter c (in 1 to guilds) has c % shard_count == shard_id
+	size_t first = session.shard_id == 0 ? session.shard_count : session.shard_id;
+	size_t shard_guilds = first > options.guilds ? 0 : (options.guilds - first) / session.shard_count + 1;
+	if (shard_guilds == 0) {
+		return;
+	}
+
+	std::uniform_real_distribution<double> share(0, 1);
+	while (session.messages_owed >= 1) {
+		session.messages_owed--;
+
+		size_t guild = first + std::uniform_int_distribution<size_t>(0, shard_guilds - 1)(rng) * session.shard_count - 1;
+		size_t channel = std::uniform_int_distribution<size_t>(0, options.channels - 1)(rng);
+
+		bool command = !options.commands.empty() && share(rng) < options.command_share;
+		size_t author = command ? 0 : std::uniform_int_distribution<size_t>(0, options.members - 1)(rng);
+		std::string content = command
+			? options.commands[std::uniform_int_distribution<size_t>(0, options.commands.size() - 1)(rng)]
+			: "message " + std::to_string(next_message);
+
+		json message = {
+			{ "id", Ids::snowflake(Ids::message_base + next_message++) },
+			{ "type", 0 },
+			{ "channel_id", Ids::snowflake(Ids::channel_base + guild * options.channels + channel) },
+			{ "guild_id", Ids::snowflake(guild + 1) },
+			{ "author", user(guild, author) },
+			{ "content", content },
+			{ "timestamp", "2017-01-01T00:00:00.000000+00:00" },
+			{ "edited_timestamp", nullptr },
+			{ "tts", false },
+			{ "mention_everyone", false },
+			{ "mentions", json::array() },
+			{ "mention_roles", json::array() },
+			{ "attachments", json::array() },
+			{ "embeds", json::array() },
+			{ "pinned", false }
+		};
+		send_dispatch(hdl, session, "MESSAGE_CREATE", message);
+		stats.messages++;
+	}
+
+	schedule_messages(hdl);
+}
+
+/* REST */
+
+void MockDiscord::on_http(websocketpp::connection_hdl hdl) {
+	server::connection_ptr con = endpoint.get_con_from_hdl(hdl);
+
+	Response response = rest(con->get_request().get_method(), con->get_resource(), con->get_request_header("Authorization"), con->get_request_body());
+
+	con->set_status(static_cast<websocketpp::http::status_code::value>(response.code));
+	con->append_header("Content-Type", "application/json");
+	for (auto &header : response.headers) {
+		con->append_header(header.first, header.second);
+	}
+	con->set_body(response.body.dump());
+
+	if (options.latency > 0) {
+		con->defer_http_response();
+		endpoint.set_timer(options.latency, [con](const websocketpp::lib::error_code &) {
+			con->send_http_response();
+		});
+	}
+}
+
+bool MockDiscord::take(Window &window, int limit, Response &response, bool global) {
+	auto now = std::chrono::steady_clock::now();
+	if (now >= window.reset) {
+		window.used = 0;
+		window.reset = now + std::chrono::seconds(1);
+	}
+
+	double reset_after = std::chrono::duration<double>(window.reset - now).count();
+	bool allowed = window.used < limit;
+	if (allowed) {
+		window.used++;
+	}
+
+	if (!global) {
+		double unix_now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+		response.headers["X-RateLimit-Limit"] = std::to_string(limit);
+		response.headers["X-RateLimit-Remaining"] = std::to_string(limit - window.used);
+		response.headers["X-RateLimit-Reset"] = std::to_string(unix_now + reset_after);
+		response.headers["X-RateLimit-Reset-After"] = std::to_string(reset_after);
+		response.headers["X-RateLimit-Bucket"] = "mock-channel-messages";
+	}
+	if (!allowed) {
+		// retry_after in ms, as the API version the bot uses sends it
+		long retry_after = static_cast<long>(std::ceil(reset_after * 1000));
+		response.code = 429;
+		response.body = { { "message", "You are being rate limited." }, { "retry_after", retry_after }, { "global", global } };
+		response.headers["Retry-After"] = std::to_string((retry_after + 999) / 1000);
+		if (global) {
+			response.headers["X-RateLimit-Global"] = "true";
+			stats.global_rate_limited++;
+		}
+		else {
+			stats.rate_limited++;
+		}
+	}
+	return allowed;
+}
+
+MockDiscord::Response MockDiscord::rest(const std::string &method, const std::string &resource, const std::string &authorization, const std::string &body) {
+	stats.rest_requests++;
+	Response response;
+
+	// e.g. /api/v6/channels/1234/messages?x=y to { "channels", "1234", "messages" }
+	std::vector<std::string> path;
+	std::string p = resource.substr(0, resource.find('?'));
+	for (size_t i = 0; i < p.size();) {
+		size_t next = std::min(p.find('/', i + 1), p.size());
+		std::string segment = p.substr(i + 1, next - i - 1);
+		bool version = segment.size() > 1 && segment[0] == 'v' && std::all_of(segment.begin() + 1, segment.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+		if (!segment.empty() && !(path.empty() && (segment == "api" || version))) {
+			path.push_back(segment);
+		}
+		i = next;
+	}
+
+	if (method == "GET" && (path == std::vector<std::string> { "gateway" } || path == std::vector<std::string> { "gateway", "bot" })) {
+		response.body = { { "url", "wss://" + options.host + ":" + std::to_string(options.port) } };
+		if (path.size() == 2) {
+			response.body["shards"] = 1;
+		}
+		return response;
+	}
+
+	if (authorization.compare(0, 4, "Bot ") != 0) {
+		response.code = 401;
+		response.body = { { "message", "401: Unauthorized" }, { "code", 0 } };
+		return response;
+	}
+	if (options.global_limit > 0 && !take(global_window, options.global_limit, response, true)) {
+		return response;
+	}
+
+	size_t guild;
+	if (method == "POST" && path.size() == 3 && path[0] == "channels" && path[2] == "messages") {
+		if (!channel_index(path[1], guild)) {
+			response.code = 404;
+			response.body = { { "message", "Unknown Channel" }, { "code", 10003 } };
+			return response;
+		}
+		if (options.rate_limit > 0 && !take(channel_windows[Ids::counter(path[1])], options.rate_limit, response, false)) {
+			return response;
+		}
+
+		std::string content;
+		try {
+			content = json::parse(body).value("content", "");
+		}
+		catch (const std::exception &) {
+			response.code = 400;
+			response.body = { { "message", "400: Bad Request" }, { "code", 0 } };
+			return response;
+		}
+		if (content.empty() || content.length() > 2000) {
+			response.code = 400;
+			response.body = { { "message", content.empty() ? "Cannot send an empty message" : "Must be 2000 or fewer in length." }, { "code", 50006 } };
+			return response;
+		}
+
+		stats.messages_posted++;
+		stats.message_lines += 1 + std::count(content.begin(), content.end(), '\n');
+		response.body = {
+			{ "id", Ids::snowflake(Ids::message_base + next_message++) },
+			{ "type", 0 },
+			{ "channel_id", path[1] },
+			{ "author", { { "id", Ids::snowflake(Ids::bot_user) }, { "username", "Toast" }, { "discriminator", "0001" }, { "avatar", nullptr }, { "bot", true } } },
+			{ "content", content },
+			{ "timestamp", "2017-01-01T00:00:00.000000+00:00" },
+			{ "tts", false },
+			{ "mention_everyone", false },
+			{ "mentions", json::array() },
+			{ "attachments", json::array() },
+			{ "embeds", json::array() }
+		};
+		return response;
+	}
+
+	if (method == "GET" && path.size() == 4 && path[0] == "guilds" && path[2] == "members") {
+		stats.member_lookups++;
+		if (!guild_index(path[1], guild)) {
+			response.code = 404;
+			response.body = { { "message", "Unknown Guild" }, { "code", 10004 } };
+			return response;
+		}
+
+		uint64_t user = Ids::counter(path[3]);
+		uint64_t first = Ids::user_base + guild * options.members;
+		if (user < first || user >= first + options.members) {
+			response.code = 404;
+			response.body = { { "message", "Unknown Member" }, { "code", 10007 } };
+			return response;
+		}
+		response.body = member(guild, user - first);
+		return response;
+	}
+
+	response.code = 404;
+	response.body = { { "message", "404: Not Found" }, { "code", 0 } };
+	return response;
+}
+
+void MockDiscord::schedule_stats() {
+	const long interval = 10;
+
+	stats_timer = endpoint.set_timer(interval * 1000, [this, interval](const websocketpp::lib::error_code &ec) {
+		if (ec) {
+			return;
+		}
+
+		auto per_second = [interval](unsigned long now, unsigned long before) {
+			return std::to_string((now - before) / interval) + "/s";
+		};
+		std::cout << sessions.size() << " connection(s): "
+			<< stats.dispatches << " dispatches (" << per_second(stats.dispatches, last_stats.dispatches) << "), "
+			<< stats.messages << " MESSAGE_CREATEs, " << stats.identifies << " identifies, " << stats.resumes << " resumes, " << stats.heartbeats << " heartbeats | "
+			<< stats.rest_requests << " REST requests (" << per_second(stats.rest_requests, last_stats.rest_requests) << "), "
+			<< stats.messages_posted << " messages posted (" << stats.message_lines << " lines), " << stats.member_lookups << " member lookups, "
+			<< stats.rate_limited + stats.global_rate_limited << " 429s (" << stats.global_rate_limited << " global)" << std::endl;
+
+		last_stats = stats;
+		schedule_stats();
+	});
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	std::string usage = std::string("usage: ") + argv[0] + " [--port n] [--host name] [--guilds n] [--members n] [--channels n] [--online f]"
+		+ " [--message-rate n] [--command text]... [--command-share f] [--latency ms] [--rate-limit n] [--global-limit n]"
+		+ " [--heartbeat-interval ms] [--cert file --key file]";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n" << usage << std::endl;
+			return 1;
+		}
+		const char *value = argv[++i];
+
+		if (arg == "--port") options.port = std::atoi(value);
+		else if (arg == "--host") options.host = value;
+		else if (arg == "--guilds") options.guilds = std::strtoul(value, nullptr, 10);
+		else if (arg == "--members") options.members = std::max(1ul, std::strtoul(value, nullptr, 10));
+		else if (arg == "--channels") options.channels = std::max(1ul, std::strtoul(value, nullptr, 10));
+		else if (arg == "--online") options.online = std::max(0.0, std::min(1.0, std::atof(value)));
+		else if (arg == "--message-rate") options.message_rate = std::max(0.0, std::atof(value));
+		else if (arg == "--command") options.commands.push_back(value);
+		else if (arg == "--command-share") options.command_share = std::max(0.0, std::min(1.0, std::atof(value)));
+		else if (arg == "--latency") options.latency = std::max(0l, std::atol(value));
+		else if (arg == "--rate-limit") options.rate_limit = std::max(0, std::atoi(value));
+		else if (arg == "--global-limit") options.global_limit = std::max(0, std::atoi(value));
+		else if (arg == "--heartbeat-interval") options.heartbeat_interval = std::max(1000, std::atoi(value));
+		else if (arg == "--cert") options.cert_file = value;
+		else if (arg == "--key") options.key_file = value;
+		else {
+			std::cerr << "Unknown argument " << arg << "\n" << usage << std::endl;
+			return 1;
+		}
+	}
+	if (options.commands.empty()) {
+		options.commands.push_back("`info");
+	}
+	if (options.guilds * options.channels >= Ids::role_base - Ids::channel_base || options.guilds >= Ids::user_base - Ids::role_base
+		|| options.guilds * options.members >= Ids::message_base - Ids::user_base) {
+		std::cerr << "Too many guilds, channels or members" << std::endl;
+		return 1;
+	}
+
+	if (options.cert_file.empty() != options.key_file.empty()) {
+		std::cerr << "--cert and --key must be given together" << std::endl;
+		return 1;
+	}
+	if (options.cert_file.empty()) {
+		options.cert_file = "MockDiscord.crt";
+		options.key_file = "MockDiscord.key";
+		if (!make_certificate(options.host, options.cert_file, options.key_file)) {
+			std::cerr << "Couldn't make a certificate" << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote a self-signed certificate to " << options.cert_file << ", use it as api_cert_file in the bot's config.json" << std::endl;
+	}
+
+	try {
+		MockDiscord mock(options);
+		mock.run();
+	}
+	catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <fstream>
 #include <ostream>
+#include <vector>
+#include <algorithm>
 
 #include "json/json.hpp"
 
@@ -36,6 +38,75 @@ void BotConfig::load_from_json(std::string data) {
 
 	js_allowed_roles = parsed["v8"].value("js_allowed_roles", std::unordered_set<std::string> { "Admin", "Coder" });
 
+	// older config files don't have this section
+	json gateway = parsed.value("gateway", json::object());
+	gateway_url = gateway.value("url", "");
+	gateway_compress = gateway.value("compress", false);
+
+	shard_count = gateway.value("shard_count", 1);
+	std::vector<int> shard_range = gateway.value("shard_range", std::vector<int> { 0, shard_count - 1 });
+	if (shard_count < 1 || shard_range.size() != 2 || shard_range[0] < 0 || shard_range[0] > shard_range[1] || shard_range[1] >= shard_count) {
+		Logger::write("Invalid shard_count/shard_range in config.json, running a single shard", Logger::LogLevel::Warning);
+		shard_count = 1;
+		shard_range = { 0, 0 };
+	}
+	shard_first = shard_range[0];
+	shard_last = shard_range[1];
+
+	gateway_record_file = gateway.value("record_file", "");
+
+	large_threshold = std::max(50, std::min(250, gateway.value("large_threshold", 250)));
+
+	std::string member_loading_name = gateway.value("member_loading", "lazy");
+	if (member_loading_name == "off") {
+		member_loading = MemberLoading::Off;
+	}
+	else if (member_loading_name == "background") {
+		member_loading = MemberLoading::Background;
+	}
+	else {
+		if (member_loading_name != "lazy") {
+			Logger::write("Unknown member_loading \"" + member_loading_name + "\" in config.json, using lazy", Logger::LogLevel::Warning);
+		}
+		member_loading = MemberLoading::Lazy;
+	}
+
+	worker_threads = std::max(0, gateway.value("worker_threads", 0));
+
+	json cache = parsed.value("cache", json::object());
+	cache_presences = cache.value("presences", true);
+
+	std::string members_name = cache.value("members", "all");
+	if (members_name == "on_demand") {
+		cache_members = MemberCaching::OnDemand;
+		if (member_loading != MemberLoading::Off) {
+			Logger::write("cache.members is on_demand, so gateway.member_loading is ignored", Logger::LogLevel::Info);
+			member_loading = MemberLoading::Off;
+		}
+	}
+	else {
+		if (members_name != "all") {
+			Logger::write("Unknown cache.members \"" + members_name + "\" in config.json, using all", Logger::LogLevel::Warning);
+		}
+		cache_members = MemberCaching::All;
+	}
+
+	max_users = std::max(0, cache.value("max_users", 0));
+
+	std::string channels_name = cache.value("channels", "all");
+	if (channels_name != "all" && channels_name != "text") {
+		Logger::write("Unknown cache.channels \"" + channels_name + "\" in config.json, using all", Logger::LogLevel::Warning);
+	}
+	cache_voice_channels = channels_name != "text";
+
+	snapshot_file = cache.value("snapshot_file", "");
+	snapshot_interval = std::max(0, cache.value("snapshot_interval", 300));
+
+	json rest = parsed.value("rest", json::object());
+	api_base_url = rest.value("base_url", "https://discordapp.com/api");
+	rest_max_in_flight = std::max(1, rest.value("max_in_flight", 8));
+	message_coalesce_ms = std::max(0, rest.value("message_coalesce_ms", 50));
+
 	Logger::write("config.json file loaded", Logger::LogLevel::Info);
 }
 
@@ -48,6 +119,29 @@ void BotConfig::create_new_file() {
 			{ "js_allowed_roles", {
 				"Admin", "Coder", "Bot Commander"
 			} }
+		} },
+		{ "gateway", {
+			{ "url", "" },
+			{ "compress", false },
+			{ "shard_count", 1 },
+			{ "shard_range", { 0, 0 } },
+			{ "record_file", "" },
+			{ "large_threshold", 250 },
+			{ "member_loading", "lazy" },
+			{ "worker_threads", 0 }
+		} },
+		{ "cache", {
+			{ "presences", true },
+			{ "members", "all" },
+			{ "max_users", 0 },
+			{ "channels", "all" },
+			{ "snapshot_file", "" },
+			{ "snapshot_interval", 300 }
+		} },
+		{ "rest", {
+			{ "base_url", "https://discordapp.com/api" },
+			{ "max_in_flight", 8 },
+			{ "message_coalesce_ms", 50 }
 		} }
 	}.dump(4);
 
@@ -57,4 +151,7 @@ void BotConfig::create_new_file() {
 
 	Logger::write("Created new config.json file", Logger::LogLevel::Info);
 	is_new_config = true;
+
+	// so everything has its default, for tools which carry on without a config (GatewayReplay)
+	load_from_json(config);
 }
\ No newline at end of file
@@ -15,6 +15,51 @@ public:
 	std::string cert_location;
 	std::unordered_set<std::string> js_allowed_roles;
 
+	// empty to ask the REST API for it
+	std::string gateway_url;
+	bool gateway_compress;
+	int shard_count;
+	// range of shards run by this process, inclusive
+	int shard_first;
+	int shard_last;
+	// empty unless gateway traffic should be recorded, see GatewayRecorder
+	std::string gateway_record_file;
+
+	// guilds with more members than this only send online members in GUILD_CREATE (50-250)
+	int large_threshold;
+	// when the rest of a large guild's members are requested
+	enum class MemberLoading {
+		Off,		// never
+		Lazy,		// when the guild is first used (a message is sent in it)
+		Background	// straight after GUILD_CREATE, paced by the gateway send queue
+	};
+	MemberLoading member_loading;
+
+	// threads parsing and handling events for each shard, 0 to share the cores between the shards in this process
+	int worker_threads;
+
+	/* cache policies, what is kept of what the gateway sends */
+	// presences are only used by the JS State and CurrentGame properties
+	bool cache_presences;
+	enum class MemberCaching {
+		All,		// every member the gateway sends
+		OnDemand	// only members who use a command which needs them (JS and custom commands), fetched over REST
+	};
+	MemberCaching cache_members;
+	// with on demand members, users beyond this many are dropped least recently used first. 0 for no limit
+	int max_users;
+	bool cache_voice_channels;
+	// empty unless the caches should be snapshotted, see CacheSnapshot. Each shard uses <snapshot_file>.<shard id>
+	std::string snapshot_file;
+	// seconds between snapshots, 0 to only write one on shutdown
+	int snapshot_interval;
+
+	std::string api_base_url;
+	// REST requests made at once, by every shard in this process
+	int rest_max_in_flight;
+	// ms messages to a channel are held to be sent together, 0 to send each by itself
+	int message_coalesce_ms;
+
 private:
 	void load_from_json(std::string data);
 	void create_new_file();
@@ -0,0 +1,381 @@
+#include "CacheSnapshot.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Logger.hpp"
+
+namespace CacheSnapshot {
+	const char magic[8] = { 'T', 'O', 'A', 'S', 'T', 'S', 'N', 'P' };
+	const size_t header_size = sizeof(magic) + 3 * sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+	static uint32_t checksum(const char *data, size_t length) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < length; i++) {
+			hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+		}
+		return hash;
+	}
+
+	class Output {
+	public:
+		Output(std::string &buffer) : buffer(buffer) {}
+
+		template <typename T>
+		void put(T value) {
+			buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+
+		void put(const std::string &value) {
+			put(static_cast<uint32_t>(value.length()));
+			buffer.append(value);
+		}
+
+		std::string &buffer;
+	};
+
+	// reads past the end (or a string longer than what's left) leave ok false, and give zeros or empty strings
+	class Input {
+	public:
+		Input(const char *data, size_t length) : pos(data), end(data + length), ok(true) {}
+
+		template <typename T>
+		T get() {
+			T value = T();
+			if (static_cast<size_t>(end - pos) < sizeof(value)) {
+				ok = false;
+				pos = end;
+				return value;
+			}
+			std::memcpy(&value, pos, sizeof(value));
+			pos += sizeof(value);
+			return value;
+		}
+
+		std::string get_string() {
+			uint32_t length = get<uint32_t>();
+			if (static_cast<size_t>(end - pos) < length) {
+				ok = false;
+				pos = end;
+				return "";
+			}
+			std::string value(pos, length);
+			pos += length;
+			return value;
+		}
+
+		bool at_end() const { return pos == end; }
+
+		const char *pos;
+		const char *end;
+		bool ok;
+	};
+
+	static void put_user(Output &out, const DiscordObjects::User &user) {
+		out.put<uint64_t>(user.id);
+		out.put(user.username);
+		out.put(user.game.str());
+		out.buffer.append(reinterpret_cast<const char *>(user.avatar), sizeof(user.avatar));
+		out.put<uint16_t>(user.discriminator);
+		out.put<uint8_t>(static_cast<uint8_t>(user.status));
+		out.put<uint8_t>(user.bot | user.mfa_enabled << 1 | user.has_avatar << 2 | user.animated_avatar << 3);
+	}
+
+	static void get_user(Input &in, DiscordObjects::User &user) {
+		user.username = in.get_string();
+		user.game = in.get_string();
+		for (uint8_t &byte : user.avatar) {
+			byte = in.get<uint8_t>();
+		}
+		user.discriminator = in.get<uint16_t>();
+		uint8_t status = in.get<uint8_t>();
+		user.status = status <= static_cast<uint8_t>(DiscordObjects::User::Status::Offline) ? static_cast<DiscordObjects::User::Status>(status) : DiscordObjects::User::Status::Offline;
+		uint8_t flags = in.get<uint8_t>();
+		user.bot = flags & 1;
+		user.mfa_enabled = flags & 2;
+		user.has_avatar = flags & 4;
+		user.animated_avatar = flags & 8;
+	}
+
+	static void put_channel(Output &out, const DiscordObjects::Channel &channel) {
+		out.put<uint64_t>(channel.id);
+		out.put<uint64_t>(channel.last_message_id);
+		out.put(channel.name);
+		out.put(channel.topic);
+		out.put<int32_t>(channel.position);
+		out.put<int32_t>(channel.bitrate);
+		out.put<int32_t>(channel.user_limit);
+		out.put<uint8_t>(static_cast<uint8_t>(channel.type));
+		out.put<uint8_t>(channel.is_private);
+	}
+
+	static void get_channel(Input &in, DiscordObjects::Channel &channel) {
+		channel.last_message_id = Snowflake(in.get<uint64_t>());
+		channel.name = in.get_string();
+		channel.topic = in.get_string();
+		channel.position = in.get<int32_t>();
+		channel.bitrate = in.get<int32_t>();
+		channel.user_limit = in.get<int32_t>();
+		channel.type = in.get<uint8_t>() == static_cast<uint8_t>(DiscordObjects::Channel::Type::Voice) ? DiscordObjects::Channel::Type::Voice : DiscordObjects::Channel::Type::Text;
+		channel.is_private = in.get<uint8_t>() != 0;
+	}
+
+	static void put_role(Output &out, const DiscordObjects::Role &role) {
+		out.put<uint64_t>(role.id);
+		out.put(role.name.str());
+		out.put<int32_t>(role.colour);
+		out.put<int32_t>(role.position);
+		out.put<uint32_t>(role.permissions);
+		out.put<uint8_t>(role.hoist | role.managed << 1 | role.mentionable << 2);
+	}
+
+	static void get_role(Input &in, DiscordObjects::Role &role) {
+		role.name = in.get_string();
+		role.colour = in.get<int32_t>();
+		role.position = in.get<int32_t>();
+		role.permissions = in.get<uint32_t>();
+		uint8_t flags = in.get<uint8_t>();
+		role.hoist = flags & 1;
+		role.managed = flags & 2;
+		role.mentionable = flags & 4;
+	}
+
+	// the member's user comes first, so each guild can be read without the others
+	static void put_member(Output &out, const DiscordObjects::GuildMember &member) {
+		put_user(out, *member.user);
+		out.put(member.nick.str());
+		out.put<int64_t>(member.joined_at);
+		out.put<uint8_t>(member.deaf | member.mute << 1);
+		out.put(static_cast<uint32_t>(member.roles.size()));
+		for (const DiscordObjects::Role *role : member.roles) {
+			out.put<uint64_t>(role->id);
+		}
+	}
+
+	static void put_guild(Output &out, const DiscordObjects::Guild &guild) {
+		out.put<uint64_t>(guild.id);
+		out.put(guild.name);
+		out.put(guild.icon);
+		out.put(guild.splash);
+		out.put<uint64_t>(guild.owner_id);
+		out.put(guild.region);
+		out.put<uint64_t>(guild.afk_channel_id);
+		out.put<int32_t>(guild.afk_timeout);
+		out.put<int32_t>(guild.verification_level);
+		out.put<uint8_t>(guild.unavailable);
+		out.put<int32_t>(guild.member_count);
+
+		out.put(static_cast<uint32_t>(guild.channels.size()));
+		for (const DiscordObjects::Channel *channel : guild.channels) {
+			put_channel(out, *channel);
+		}
+		out.put(static_cast<uint32_t>(guild.roles.size()));
+		for (const DiscordObjects::Role *role : guild.roles) {
+			put_role(out, *role);
+		}
+		out.put(static_cast<uint32_t>(guild.members.size()));
+		for (const DiscordObjects::GuildMember *member : guild.members) {
+			put_member(out, *member);
+		}
+	}
+
+	Writer::Writer() {
+		guild_count = 0;
+		buffer.resize(header_size + sizeof(uint32_t)); // filled in by finish(), once the guilds are counted and checksummed
+	}
+
+	void Writer::add_guild(const DiscordObjects::Guild &guild) {
+		Output out(buffer);
+		put_guild(out, guild);
+		guild_count++;
+	}
+
+	std::string Writer::finish(int shard_id, int shard_count) {
+		std::memcpy(&buffer[header_size], &guild_count, sizeof(guild_count));
+
+		std::string header_buffer;
+		Output header(header_buffer);
+		header.buffer.append(magic, sizeof(magic));
+		header.put<uint32_t>(version);
+		header.put<uint32_t>(shard_id);
+		header.put<uint32_t>(shard_count);
+		header.put<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		header.put<uint64_t>(buffer.length() - header_size);
+		header.put<uint32_t>(checksum(buffer.data() + header_size, buffer.length() - header_size));
+		buffer.replace(0, header_size, header_buffer);
+
+		return std::move(buffer);
+	}
+
+	bool write_file(const std::string &path, const std::string &snapshot) {
+		std::string temp_path = path + ".tmp";
+
+		// fsynced before the rename, or a crash could leave the new name pointing at a file whose data never reached the disk
+		int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) {
+			Logger::write("[snapshot] Couldn't open " + temp_path, Logger::LogLevel::Warning);
+			return false;
+		}
+		size_t written = 0;
+		while (written < snapshot.length()) {
+			ssize_t n = write(fd, snapshot.data() + written, snapshot.length() - written);
+			if (n <= 0) break;
+			written += n;
+		}
+		bool ok = written == snapshot.length() && fsync(fd) == 0;
+		ok = close(fd) == 0 && ok;
+		if (!ok) {
+			Logger::write("[snapshot] Couldn't write " + temp_path, Logger::LogLevel::Warning);
+			return false;
+		}
+
+		if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+			Logger::write("[snapshot] Couldn't replace " + path + " with " + temp_path, Logger::LogLevel::Warning);
+			return false;
+		}
+		return true;
+	}
+
+	Reader::Reader(std::string path) {
+		valid = false;
+		data = nullptr;
+		size = 0;
+		shard_id = shard_count = 0;
+		created_unix_ms = body_length = 0;
+		body_checksum = 0;
+
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1) {
+			return;
+		}
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= header_size) {
+			void *mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				data = static_cast<const char *>(mapped);
+				size = file_stat.st_size;
+				madvise(mapped, size, MADV_SEQUENTIAL);
+			}
+		}
+		close(fd); // the mapping keeps the file open
+
+		if (!data) {
+			return;
+		}
+
+		Input in(data, size);
+		in.pos += sizeof(magic);
+		uint32_t file_version = in.get<uint32_t>();
+		shard_id = in.get<uint32_t>();
+		shard_count = in.get<uint32_t>();
+		created_unix_ms = in.get<uint64_t>();
+		body_length = in.get<uint64_t>();
+		body_checksum = in.get<uint32_t>();
+
+		valid = std::memcmp(data, magic, sizeof(magic)) == 0 && file_version == version;
+	}
+
+	Reader::~Reader() {
+		if (data) {
+			munmap(const_cast<char *>(data), size);
+		}
+	}
+
+	bool Reader::load(SnowflakeMap<DiscordObjects::Guild> &guilds, SnowflakeMap<DiscordObjects::Channel> &channels,
+		SnowflakeMap<DiscordObjects::User> &users, SnowflakeMap<DiscordObjects::Role> &roles) {
+		if (!valid) {
+			return false;
+		}
+
+		if (body_length != size - header_size || checksum(data + header_size, body_length) != body_checksum) {
+			Logger::write("[snapshot] Snapshot is truncated or corrupt", Logger::LogLevel::Warning);
+			return false;
+		}
+
+		Input in(data + header_size, body_length);
+
+		uint32_t guild_count = in.get<uint32_t>();
+		guilds.reserve(guilds.size() + guild_count);
+		for (uint32_t i = 0; i < guild_count && in.ok; i++) {
+			uint64_t guild_id = in.get<uint64_t>();
+			DiscordObjects::Guild &guild = guilds[guild_id];
+			guild = DiscordObjects::Guild();
+			guild.id = Snowflake(guild_id);
+			guild.name = in.get_string();
+			guild.icon = in.get_string();
+			guild.splash = in.get_string();
+			guild.owner_id = Snowflake(in.get<uint64_t>());
+			guild.region = in.get_string();
+			guild.afk_channel_id = Snowflake(in.get<uint64_t>());
+			guild.afk_timeout = in.get<int32_t>();
+			guild.verification_level = in.get<int32_t>();
+			guild.unavailable = in.get<uint8_t>() != 0;
+			guild.member_count = in.get<int32_t>();
+
+			uint32_t channel_count = in.get<uint32_t>();
+			for (uint32_t j = 0; j < channel_count && in.ok; j++) {
+				uint64_t channel_id = in.get<uint64_t>();
+				DiscordObjects::Channel &channel = channels[channel_id];
+				channel.id = Snowflake(channel_id);
+				channel.guild_id = guild.id;
+				get_channel(in, channel);
+				guild.channels.push_back(&channel);
+			}
+
+			uint32_t role_count = in.get<uint32_t>();
+			for (uint32_t j = 0; j < role_count && in.ok; j++) {
+				uint64_t role_id = in.get<uint64_t>();
+				DiscordObjects::Role &role = roles[role_id];
+				role.id = Snowflake(role_id);
+				get_role(in, role);
+				guild.roles.push_back(&role);
+			}
+
+			uint32_t member_count = in.get<uint32_t>();
+			for (uint32_t j = 0; j < member_count && in.ok; j++) {
+				uint64_t user_id = in.get<uint64_t>();
+				if (user_id == 0 || guild.find_member(user_id)) {
+					in.ok = false;
+					break;
+				}
+				// users in several guilds are in each of them, the copies only differ if the user changed in between
+				DiscordObjects::User &user = users[user_id];
+				user.id = Snowflake(user_id);
+				get_user(in, user);
+
+				DiscordObjects::GuildMember *member = guild.add_member(&user);
+				user.guilds.push_back(guild.id);
+				member->nick = in.get_string();
+				member->joined_at = in.get<int64_t>();
+				uint8_t flags = in.get<uint8_t>();
+				member->deaf = flags & 1;
+				member->mute = flags & 2;
+
+				uint32_t member_role_count = in.get<uint32_t>();
+				for (uint32_t k = 0; k < member_role_count && in.ok; k++) {
+					uint64_t role_id = in.get<uint64_t>();
+					if (role_id != 0) { // a role the member had which was never created
+						member->roles.push_back(&roles[role_id]);
+					}
+				}
+			}
+
+			// only the members that were loaded are in the snapshot, the rest are requested as usual
+			guild.member_list = static_cast<int>(guild.members.size()) < guild.member_count ? DiscordObjects::Guild::MemberList::Partial : DiscordObjects::Guild::MemberList::Complete;
+			guild.from_snapshot = true;
+		}
+
+		if (!in.ok || !in.at_end()) {
+			Logger::write("[snapshot] Snapshot doesn't match its layout", Logger::LogLevel::Warning);
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef BOT_CACHESNAPSHOT
+#define BOT_CACHESNAPSHOT
+
+#include <string>
+#include <cstdint>
+
+#include "SnowflakeMap.hpp"
+#include "data_structures/Guild.hpp"
+#include "data_structures/Channel.hpp"
+#include "data_structures/User.hpp"
+#include "data_structures/Role.hpp"
+
+/*
+* Binary copy of a shard's caches, written periodically and loaded at startup so lookups work before the gateway has
+* sent every GUILD_CREATE again.
+*
+* File layout (host byte order):
+*   header: "TOASTSNP" | uint32 version | uint32 shard id | uint32 shard count | uint64 created (unix ms) | uint64 body length | uint32 body checksum (FNV-1a)
+*   body:   uint32 guild count | guilds, each followed by its channels, roles and members. Each member starts with its user.
+*
+* Strings are a uint32 length then the bytes, ids are uint64. Any change to the layout must bump the version, older
+* snapshots are then ignored rather than converted.
+*
+* Every guild is complete in itself, so the caches only have to stay unchanged while one guild is added, and the lock
+* can be released in between.
+*/
+namespace CacheSnapshot {
+	const uint32_t version = 2;
+
+	class Writer {
+	public:
+		Writer();
+
+		// The guild, its channels and roles, and its members and their users must not change while it runs
+		// (cache_mutex held shared is enough)
+		void add_guild(const DiscordObjects::Guild &guild);
+
+		// The whole snapshot, header included. The writer is empty afterwards.
+		std::string finish(int shard_id, int shard_count);
+
+	private:
+		std::string buffer;
+		uint32_t guild_count;
+	};
+
+	// Writes to a temporary file then renames it over path, so a crash while writing leaves the previous snapshot
+	bool write_file(const std::string &path, const std::string &snapshot);
+
+	// Maps a snapshot file into memory
+	class Reader {
+	public:
+		Reader(std::string path);
+		~Reader();
+
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+
+		// false if the file is missing, or isn't a snapshot of this version
+		bool is_open() const { return valid; }
+
+		// Adds everything in the snapshot to the caches. false if it is truncated or corrupt, the caches may then hold part of it.
+		bool load(SnowflakeMap<DiscordObjects::Guild> &guilds, SnowflakeMap<DiscordObjects::Channel> &channels,
+			SnowflakeMap<DiscordObjects::User> &users, SnowflakeMap<DiscordObjects::Role> &roles);
+
+		uint32_t shard_id;
+		uint32_t shard_count;
+		uint64_t created_unix_ms;
+		size_t size;
+
+	private:
+		const char *data;
+		uint64_t body_length;
+		uint32_t body_checksum;
+		bool valid;
+	};
+}
+
+#endif
@@ -2,11 +2,23 @@
 
 #include <cstdio>
 #include <iostream>
+#include <algorithm>
+
+#include <boost/thread.hpp>
 
 #include "Logger.hpp"
 #include "BotConfig.hpp"
 
-ClientConnection::ClientConnection(BotConfig &c) : config(c), gh(config) {
+ClientConnection::ClientConnection(BotConfig &c, ShardManager *manager, int shard_id) : config(c), gh(config, manager, shard_id) {
+	stopping = false;
+	reconnect = false;
+	reconnect_delay = 1;
+	reconnect_now = false;
+
+	if (!config.gateway_record_file.empty()) {
+		recorder = std::unique_ptr<GatewayRecorder::Writer>(new GatewayRecorder::Writer(config.gateway_record_file + "." + std::to_string(shard_id)));
+	}
+
 	// Reset the log channels
 	cli.clear_access_channels(websocketpp::log::alevel::all);
 
@@ -53,21 +65,66 @@ ClientConnection::ClientConnection(BotConfig &c) : config(c), gh(config) {
 
 // Open a connection to the URI provided
 void ClientConnection::start(std::string uri) {
-	websocketpp::lib::error_code ec;
-	client::connection_ptr con = cli.get_connection(uri, ec);
-
-	if (ec) { // failed to create connection
-		Logger::write("Failed to create connection: " + ec.message(), Logger::LogLevel::Severe);
-		return;
+	while (true) {
+		websocketpp::lib::error_code ec;
+		client::connection_ptr con = cli.get_connection(uri, ec);
+
+		if (ec) { // failed to create connection
+			Logger::write("Failed to create connection: " + ec.message(), Logger::LogLevel::Severe);
+			return;
+		}
+
+		// Open the connection
+		reconnect = false;
+		cli.connect(con);
+		try {
+			cli.run();
+		}
+		catch (websocketpp::lib::error_code e) {
+			Logger::write("websocketpp exception: " + e.message(), Logger::LogLevel::Warning);
+			gh.on_disconnect(0);
+			reconnect = true;
+		}
+
+		if (stopping || !reconnect) {
+			break;
+		}
+
+		// the GatewayHandler, with its session, cache and v8 instances, is kept for the next connection
+		if (reconnect_now) {
+			Logger::write("Reconnecting", Logger::LogLevel::Info);
+			reconnect_now = false;
+		}
+		else {
+			Logger::write("Reconnecting in " + std::to_string(reconnect_delay) + " seconds", Logger::LogLevel::Info);
+			boost::this_thread::sleep_for(boost::chrono::seconds(reconnect_delay));
+			reconnect_delay = std::min(reconnect_delay * 2, 64);
+		}
+		if (stopping) {
+			break;
+		}
+
+		cli.reset();
 	}
 
-	// Open the connection
-	cli.connect(con);
-	cli.run();
-
 	Logger::write("Finished running", Logger::LogLevel::Debug);
 }
 
+void ClientConnection::stop() {
+	stopping = true;
+
+	// websocketpp handlers and the gateway handler's state belong to the io thread
+	cli.get_io_service().post([this]() {
+		gh.shutdown();
+
+		websocketpp::lib::error_code ec;
+		cli.close(current_hdl, websocketpp::close::status::going_away, "", ec);
+		if (ec) { // wasn't connected
+			cli.stop();
+		}
+	});
+}
+
 // Event handlers
 void ClientConnection::on_socket_init(websocketpp::connection_hdl) {
 	Logger::write("Socket initialised", Logger::LogLevel::Debug);
@@ -100,25 +157,69 @@ void ClientConnection::on_fail(websocketpp::connection_hdl hdl) {
 		con->get_remote_close_reason() + "\n" +
 		std::to_string(con->get_ec().value()) + " - " + con->get_ec().message() + "\n",
 		Logger::LogLevel::Severe);
+
+	gh.on_disconnect(0);
+	reconnect = !stopping;
+	cli.stop();
 }
 
 void ClientConnection::on_open(websocketpp::connection_hdl hdl) {
 	Logger::write("Connection opened", Logger::LogLevel::Debug);
+	current_hdl = hdl;
+	reconnect_delay = 1;
+
+	// each connection starts a new zlib stream
+	inflater.reset();
 }
 
 void ClientConnection::on_message(websocketpp::connection_hdl hdl, message_ptr message) {
-	if (message->get_opcode() != websocketpp::frame::opcode::text) {
+	std::string *payload;
+
+	if (config.gateway_compress && message->get_opcode() == websocketpp::frame::opcode::binary) {
+		InflateStream::Result result = inflater.feed(message->get_payload(), inflate_buffer);
+		if (result == InflateStream::Result::Incomplete) {
+			return;
+		}
+		if (result == InflateStream::Result::Error) {
+			// nothing more can be inflated from this stream, so resume on a new connection with a fresh one
+			Logger::write("[zlib] Gateway stream is corrupt, reconnecting", Logger::LogLevel::Warning);
+			inflater.reset();
+			reconnect_now = true;
+
+			websocketpp::lib::error_code ec;
+			cli.close(hdl, 4000, "Inflate error", ec);
+			return;
+		}
+		payload = &inflate_buffer;
+	}
+	else if (message->get_opcode() == websocketpp::frame::opcode::text) {
+		payload = &message->get_raw_payload();
+	}
+	else {
 		// If the message is not text, just print as hex
 		Logger::write("Non-text message received: " + websocketpp::utility::to_hex(message->get_payload()), Logger::LogLevel::Warning);
 		return;
 	}
 
+	if (recorder) {
+		recorder->record(*payload);
+	}
 
 	// Pass the message to the gateway handler
-	gh.handle_data(message->get_payload(), cli, hdl);
+	gh.handle_data(std::move(*payload), cli, hdl);
 }
 
-void ClientConnection::on_close(websocketpp::connection_hdl) {
-	Logger::write("Connection closed", Logger::LogLevel::Info);
+void ClientConnection::on_close(websocketpp::connection_hdl hdl) {
+	client::connection_ptr con = cli.get_con_from_hdl(hdl);
+	int close_code = con->get_remote_close_code();
+
+	Logger::write("Connection closed (code " + std::to_string(close_code) + ": " + con->get_remote_close_reason() + ")", Logger::LogLevel::Info);
+	reconnect = gh.on_disconnect(close_code) && !stopping;
+
+	if (config.gateway_compress) {
+		Logger::write("[zlib] Received " + std::to_string(inflater.compressed_bytes) + " compressed bytes, inflated to "
+			+ std::to_string(inflater.inflated_bytes) + " bytes", Logger::LogLevel::Info);
+	}
+
 	cli.stop();
 }
\ No newline at end of file
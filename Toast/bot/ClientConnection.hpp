@@ -1,11 +1,16 @@
 #ifndef BOT_CLIENTCONNECTION
 #define BOT_CLIENTCONNECTION
 
+#include <atomic>
+#include <memory>
+
 #include <websocketpp/client.hpp>
 #include <websocketpp/config/asio_client.hpp>
 #include "json/json.hpp"
 
 #include "GatewayHandler.hpp"
+#include "InflateStream.hpp"
+#include "GatewayRecorder.hpp"
 
 typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
 
@@ -17,18 +22,36 @@ typedef websocketpp::lib::shared_ptr<boost::asio::ssl::context> context_ptr;
 typedef client::connection_ptr connection_ptr;
 
 class BotConfig;
+class ShardManager;
 
 class ClientConnection {
 public:
-	ClientConnection(BotConfig &c);
+	ClientConnection(BotConfig &c, ShardManager *manager, int shard_id);
 
-	// Open a connection to the URI provided
+	// Open a connection to the URI provided, reconnecting (and resuming the session) until stopped
 	void start(std::string uri);
+	// Close the connection for good, from any thread
+	void stop();
 
 private:
 	client cli;
 	BotConfig &config;
 	GatewayHandler gh;
+	websocketpp::connection_hdl current_hdl;
+
+	std::atomic<bool> stopping;
+	bool reconnect;
+	// seconds, doubles after each failed attempt
+	int reconnect_delay;
+	// the connection was closed by us and can be resumed straight away
+	bool reconnect_now;
+
+	// zlib-stream transport compression
+	InflateStream inflater;
+	std::string inflate_buffer;
+
+	// null unless gateway.record_file is set
+	std::unique_ptr<GatewayRecorder::Writer> recorder;
 
 	// Event handlers
 	void on_socket_init(websocketpp::connection_hdl);
@@ -1,20 +1,88 @@
 #include "DiscordAPI.hpp"
 
-#include <cstdio>
-#include <thread>
-#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
 
 #include "http/HTTP.hpp"
 #include "Logger.hpp"
 
-using namespace std::chrono_literals;
-
 namespace DiscordAPI {
-	const std::string base_url = "https://discordapp.com/api";
-	const std::string channels_url = base_url + "/channels";
-	const std::string gateway_url = base_url + "/gateway";
+	// only set before any request is made
+	std::string base_url = "https://discordapp.com/api";
 
 	const std::string json_mime_type = "application/json";
+	const size_t max_message_length = 2000;
+
+	// messages to a channel waiting out the coalescing window, to be sent as one
+	struct Outbox {
+		unsigned long id; // so a window's timer only flushes the outbox it was started for
+		std::string content;
+		std::string token;
+		std::string ca_location;
+	};
+
+	std::mutex outbox_mutex;
+	std::chrono::milliseconds coalesce_window(0);
+	// <channel id, outbox>
+	std::unordered_map<std::string, Outbox> outboxes;
+	unsigned long next_outbox_id = 0;
+	unsigned long messages_sent = 0;
+	unsigned long message_requests = 0;
+
+	void post_message(const std::string &channel_id, const std::string &content, const std::string &token, const std::string &ca_location) {
+		json data = {
+			{ "content", content }
+		};
+
+		HTTP::Request request;
+		request.method = "POST";
+		request.url = base_url + "/channels/" + channel_id + "/messages";
+		request.content_type = json_mime_type;
+		request.body = data.dump();
+		request.token = token;
+		request.ca_location = ca_location;
+		request.queue = "channel " + channel_id;
+
+		HTTP::request(request, [channel_id](const HTTP::Response &response) {
+			if (response.code != 200) {
+				Logger::write("[API] [send_message] Giving up on sending message to channel " + channel_id + " ("
+					+ (response.code ? std::to_string(response.code) : response.error) + ")", Logger::LogLevel::Warning);
+			}
+		});
+	}
+
+	// must hold outbox_mutex. The request is only submitted, so holding the lock keeps the channel's messages in order.
+	void flush_outbox(std::unordered_map<std::string, Outbox>::iterator it) {
+		post_message(it->first, it->second.content, it->second.token, it->second.ca_location);
+		message_requests++;
+		outboxes.erase(it);
+	}
+
+	void set_base_url(std::string url) {
+		while (!url.empty() && url.back() == '/') {
+			url.pop_back();
+		}
+		base_url = url;
+	}
+
+	void set_coalesce_window(std::chrono::milliseconds window) {
+		std::lock_guard<std::mutex> lock(outbox_mutex);
+		coalesce_window = std::max(std::chrono::milliseconds(0), window);
+	}
+
+	void flush_messages() {
+		std::lock_guard<std::mutex> lock(outbox_mutex);
+		while (!outboxes.empty()) {
+			flush_outbox(outboxes.begin());
+		}
+	}
+
+	std::string stats_string() {
+		std::lock_guard<std::mutex> lock(outbox_mutex);
+		return "\n**messages:** " + std::to_string(messages_sent) + " sent in " + std::to_string(message_requests) + " request(s), "
+			+ std::to_string(messages_sent - message_requests) + " saved by coalescing (" + std::to_string(coalesce_window.count()) + "ms window)";
+	}
 
 	void send_message(std::string channel_id, std::string message, std::string token, std::string ca_location) {
 		if (message == "") {
@@ -26,59 +94,79 @@ namespace DiscordAPI {
 			Logger::write("[API] [send_message] Tried to send a message over 4000 characters", Logger::LogLevel::Warning);
 			return;
 		}
-		else if (message.length() > 2000) {
-			std::cout << message.length() << std::endl;
-
-			std::string first = message.substr(0, 2000);
-			std::string second = message.substr(2000);
-			send_message(channel_id, first, token, ca_location);
-			std::this_thread::sleep_for(50ms);
-			send_message(channel_id, second, token, ca_location);
+		else if (message.length() > max_message_length) {
+			// the channel's queue keeps the halves in order
+			send_message(channel_id, message.substr(0, max_message_length), token, ca_location);
+			send_message(channel_id, message.substr(max_message_length), token, ca_location);
 			return;
 		}
 
-		const std::string url = channels_url + "/" + channel_id + "/messages";
-		json data = {
-			{ "content", message }
-		};
-
-		std::string response;
-		long response_code = 0;
-		response = HTTP::post_request(url, json_mime_type, data.dump(), &response_code, token, ca_location);
-
-		int retries = 0;
-		while (response_code != 200 && retries < 2) {
-			Logger::write("[API] [send_message] Got non-200 response code, retrying", Logger::LogLevel::Warning);
-			std::this_thread::sleep_for(100ms);
-			// try 3 times. usually enough to prevent 502 bad gateway issues
-			response = HTTP::post_request(url, json_mime_type, data.dump(), &response_code, token, ca_location);
-			retries++;
+		std::lock_guard<std::mutex> lock(outbox_mutex);
+		messages_sent++;
+
+		auto it = outboxes.find(channel_id);
+		if (it != outboxes.end()) {
+			Outbox &outbox = it->second;
+			if (outbox.content.length() + 1 + message.length() <= max_message_length && outbox.token == token && outbox.ca_location == ca_location) {
+				outbox.content += "\n" + message;
+				return;
+			}
+			// doesn't fit, so what's there goes now and this starts a new window
+			flush_outbox(it);
 		}
 
-		if (response_code != 200) {
-			Logger::write("[API] [send_message] Giving up on sending message", Logger::LogLevel::Warning);
+		if (coalesce_window.count() == 0) {
+			post_message(channel_id, message, token, ca_location);
+			message_requests++;
+			return;
 		}
+
+		unsigned long id = next_outbox_id++;
+		outboxes[channel_id] = Outbox { id, message, token, ca_location };
+		HTTP::after(coalesce_window, [channel_id, id]() {
+			std::lock_guard<std::mutex> lock(outbox_mutex);
+			auto it = outboxes.find(channel_id);
+			if (it != outboxes.end() && it->second.id == id) {
+				flush_outbox(it);
+			}
+		});
 	}
 
 	json get_gateway(std::string ca_location) {
-		std::string response;
-		long response_code;
-		response = HTTP::get_request(gateway_url, &response_code, "", ca_location);
-
-		int retries = 0;
-		while (response_code != 200 && retries < 4) {
-			Logger::write("[API] [get_gateway] Got non-200 response code, retrying", Logger::LogLevel::Warning);
-			std::this_thread::sleep_for(100ms);
-			// try 3 times. usually enough to prevent 502 bad gateway issues
-			response = HTTP::get_request(gateway_url, &response_code, "", ca_location);
-			retries++;
-		}
+		HTTP::Request request;
+		request.url = base_url + "/gateway";
+		request.ca_location = ca_location;
+		request.retries = 4;
 
-		if (response_code != 200) {
+		HTTP::Response response = HTTP::request_sync(request);
+		if (response.code != 200) {
 			Logger::write("[API] [get_gateway] Giving up on getting gateway url", Logger::LogLevel::Warning);
 			return json {};
 		}
 
-		return json::parse(response);
+		return json::parse(response.body);
+	}
+
+	void get_guild_member(std::string guild_id, std::string user_id, std::string token, std::string ca_location, std::function<void(json member)> callback) {
+		HTTP::Request request;
+		request.url = base_url + "/guilds/" + guild_id + "/members/" + user_id;
+		request.token = token;
+		request.ca_location = ca_location;
+
+		// 404 means they aren't a member, which isn't retried
+		HTTP::request(request, [guild_id, user_id, callback](const HTTP::Response &response) {
+			json member;
+			if (response.code == 200) {
+				try {
+					member = json::parse(response.body);
+				}
+				catch (const std::exception &) {}
+			}
+			if (member.is_null()) {
+				Logger::write("[API] [get_guild_member] Couldn't get member " + user_id + " of guild " + guild_id + " (" + std::to_string(response.code) + ")", Logger::LogLevel::Warning);
+			}
+
+			callback(std::move(member));
+		});
 	}
-}
\ No newline at end of file
+}
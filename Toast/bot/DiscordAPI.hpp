@@ -1,7 +1,9 @@
 #ifndef BOT_APIHELPER
 #define BOT_APIHELPER
 
+#include <chrono>
 #include <string>
+#include <functional>
 
 #include "json/json.hpp"
 
@@ -10,8 +12,22 @@ using json = nlohmann::json;
 class BotConfig;
 
 namespace DiscordAPI {
+	// where requests are made, e.g. a MockDiscord server. Only to be set before the first request.
+	void set_base_url(std::string url);
+	// blocks until the response arrives
 	json get_gateway(std::string ca_location);
+	// returns straight away, the message is sent in the background. Messages to a channel are sent in the order given.
+	// Messages to a channel within the coalescing window of the first are sent together, a line each, up to 2000 characters.
 	void send_message(std::string channel_id, std::string message, std::string token, std::string ca_location);
+	// 0 to send every message by itself
+	void set_coalesce_window(std::chrono::milliseconds window);
+	// sends what is waiting in the coalescing window now, before HTTP::cleanup
+	void flush_messages();
+	// messages sent, the requests they took and the requests saved by coalescing
+	std::string stats_string();
+	// returns straight away. callback gets the guild member object, or null if they aren't a member or the request failed.
+	// It runs on the HTTP client's thread, so must not block.
+	void get_guild_member(std::string guild_id, std::string user_id, std::string token, std::string ca_location, std::function<void(json member)> callback);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "EventPipeline.hpp"
+
+#include <algorithm>
+
+#include "Logger.hpp"
+
+EventPipeline::EventPipeline(int thread_count) : work(new boost::asio::io_service::work(service)) {
+	next_sequence = next_release = 0;
+	outstanding = 0;
+
+	threads_started = std::max(1, thread_count);
+	for (int i = 0; i < threads_started; i++) {
+		threads.create_thread([this]() {
+			service.run();
+		});
+	}
+}
+
+EventPipeline::~EventPipeline() {
+	stop();
+}
+
+void EventPipeline::submit(std::function<void()> parse, std::function<std::string()> route, std::function<void()> handle) {
+	if (!work) {
+		return; // stopped
+	}
+
+	uint64_t sequence;
+	{
+		std::lock_guard<std::mutex> lock(sequence_mutex);
+		sequence = next_sequence++;
+		pending[sequence] = { std::move(route), std::move(handle), false, false };
+	}
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		outstanding++;
+	}
+
+	service.post([this, sequence, parse]() {
+		bool failed = false;
+		try {
+			parse();
+		}
+		catch (const std::exception &e) {
+			Logger::write("[pipeline] Couldn't parse event: " + std::string(e.what()), Logger::LogLevel::Severe);
+			failed = true;
+		}
+
+		on_parsed(sequence, failed);
+	});
+}
+
+void EventPipeline::on_parsed(uint64_t sequence, bool failed) {
+	std::lock_guard<std::mutex> lock(sequence_mutex);
+
+	Submission &parsed = pending[sequence];
+	parsed.parsed = true;
+	parsed.failed = failed;
+
+	// release everything which is now in order, whichever worker parsed it
+	auto it = pending.begin();
+	while (it != pending.end() && it->first == next_release && it->second.parsed) {
+		Submission &submission = it->second;
+
+		if (submission.failed) {
+			finished();
+		}
+		else {
+			std::string key;
+			try {
+				key = submission.route();
+			}
+			catch (const std::exception &e) {
+				Logger::write("[pipeline] Couldn't route event: " + std::string(e.what()), Logger::LogLevel::Severe);
+			}
+
+			std::unique_ptr<boost::asio::io_service::strand> &strand = strands[key];
+			if (!strand) {
+				strand.reset(new boost::asio::io_service::strand(service));
+			}
+
+			std::function<void()> handle = std::move(submission.handle);
+			strand->post([this, handle]() {
+				try {
+					handle();
+				}
+				catch (const std::exception &e) {
+					Logger::write("[pipeline] Event handler failed: " + std::string(e.what()), Logger::LogLevel::Severe);
+				}
+				finished();
+			});
+		}
+
+		it = pending.erase(it);
+		next_release++;
+	}
+}
+
+void EventPipeline::finished() {
+	std::lock_guard<std::mutex> lock(idle_mutex);
+	if (--outstanding == 0) {
+		idle.notify_all();
+	}
+}
+
+void EventPipeline::wait_idle() {
+	std::unique_lock<std::mutex> lock(idle_mutex);
+	idle.wait(lock, [this]() { return outstanding == 0; });
+}
+
+size_t EventPipeline::backlog() {
+	std::lock_guard<std::mutex> lock(idle_mutex);
+	return outstanding;
+}
+
+void EventPipeline::stop() {
+	if (!work) {
+		return;
+	}
+
+	// without the work object, run() returns once the queue is empty
+	work.reset();
+	threads.join_all();
+}
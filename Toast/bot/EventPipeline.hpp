@@ -0,0 +1,68 @@
+#ifndef BOT_EVENTPIPELINE
+#define BOT_EVENTPIPELINE
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+/*
+* Runs gateway events on a pool of worker threads, in three steps:
+*   parse   runs as soon as a worker is free, so frames are parsed in parallel and in any order.
+*   route   runs once every earlier submission has been routed, so always one at a time and in submission order.
+*           It returns the key (a guild id) of the executor the handler runs on.
+*   handle  runs on the key's executor (a strand), so handlers with the same key run one at a time, in submission order.
+* Handlers with different keys run in parallel, anything they share must be locked by the caller.
+*/
+class EventPipeline {
+public:
+	EventPipeline(int thread_count);
+	~EventPipeline();
+
+	void submit(std::function<void()> parse, std::function<std::string()> route, std::function<void()> handle);
+
+	// Blocks until everything submitted so far has been handled
+	void wait_idle();
+	// Handles everything submitted so far, then joins the workers. Must not be called from a worker.
+	void stop();
+
+	int thread_count() const { return threads_started; }
+	// submitted but not yet handled
+	size_t backlog();
+
+private:
+	struct Submission {
+		std::function<std::string()> route;
+		std::function<void()> handle;
+		bool parsed;
+		bool failed;
+	};
+
+	void on_parsed(uint64_t sequence, bool failed);
+	void finished();
+
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	boost::thread_group threads;
+	int threads_started;
+
+	std::mutex sequence_mutex;
+	uint64_t next_sequence;
+	uint64_t next_release;
+	// <sequence, submission> for everything not yet released to its strand
+	std::map<uint64_t, Submission> pending;
+	// <key, executor>, strands are never removed so a key always maps to the same one
+	std::unordered_map<std::string, std::unique_ptr<boost::asio::io_service::strand>> strands;
+
+	std::mutex idle_mutex;
+	std::condition_variable idle;
+	size_t outstanding;
+};
+
+#endif
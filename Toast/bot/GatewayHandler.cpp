@@ -1,60 +1,266 @@
 #include "GatewayHandler.hpp"
 
+#include <random>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <shared_mutex>
+#include <unordered_set>
+
 #include <boost/algorithm/string.hpp>
 
 #include "DiscordAPI.hpp"
 #include "Logger.hpp"
 #include "data_structures/GuildMember.hpp"
 #include "BotConfig.hpp"
+#include "ShardManager.hpp"
+#include "CacheSnapshot.hpp"
+#include "http/HTTP.hpp"
+
+/* const json::operator[] requires the key to exist, so optional arrays (e.g. those missing from unavailable guilds) go through this */
+static const json empty_array = json::array();
+
+static const json &array_or_empty(const json &data, const std::string &key) {
+	auto it = data.find(key);
+	return it == data.end() ? empty_array : *it;
+}
+
+bool GatewayHandler::peek_event_name(const std::string &data, std::string &event_name) {
+	static const std::string prefix = "{\"t\":\"";
+
+	if (data.compare(0, prefix.length(), prefix) != 0) {
+		return false;
+	}
+
+	size_t end = data.find('"', prefix.length());
+	if (end == std::string::npos) {
+		return false;
+	}
+
+	event_name = data.substr(prefix.length(), end - prefix.length());
+	return true;
+}
+
+/* parser callback which drops the top level "d" object/array, it is never built */
+static bool skip_payload(int depth, json::parse_event_t event, json &parsed) {
+	static thread_local bool in_payload = false;
+
+	if (depth == 1 && event == json::parse_event_t::key) {
+		in_payload = parsed == "d";
+	}
+	else if (depth == 1 && in_payload && (event == json::parse_event_t::object_start || event == json::parse_event_t::array_start)) {
+		in_payload = false;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+* parser callback which leaves the named arrays out of the "d" object, they are never built.
+*
+* The parser's depth is one too deep after an array it was told to drop, unless the array was empty, so the nesting is
+* counted here instead. Dropped arrays give no events, except an empty one which still ends (with a discarded value).
+* e.g. with {"d":{"presences":[],"members":[{...}]}}, assuming every dropped array leaves the depth one too deep would look
+* for "members" a level too deep after the empty presences, and keep it.
+*/
+static json::parser_callback_t skip_lists(const std::vector<std::string> &names) {
+	int level = 0;
+	bool d_key = false, in_d = false, skipping = false;
+
+	return [names, level, d_key, in_d, skipping](int, json::parse_event_t event, json &parsed) mutable {
+		switch (event) {
+		case json::parse_event_t::key:
+			if (level == 1) {
+				d_key = parsed == "d";
+			}
+			else if (level == 2 && in_d) {
+				skipping = std::find(names.begin(), names.end(), parsed.get<std::string>()) != names.end();
+			}
+			break;
+		case json::parse_event_t::object_start:
+		case json::parse_event_t::array_start:
+			if (level == 2 && in_d && skipping && event == json::parse_event_t::array_start) {
+				skipping = false;
+				return false;
+			}
+			if (level == 1) {
+				in_d = d_key;
+			}
+			level++;
+			break;
+		case json::parse_event_t::object_end:
+		case json::parse_event_t::array_end:
+			if (!parsed.is_discarded()) {
+				level--;
+			}
+			break;
+		default:
+			break;
+		}
 
-GatewayHandler::GatewayHandler(BotConfig &c) : config(c) {
+		return true;
+	};
+}
+
+const std::unordered_map<std::string, GatewayHandler::Event> GatewayHandler::event_table = {
+	{ "PRESENCE_UPDATE", Event::PresenceUpdate },
+	{ "MESSAGE_CREATE", Event::MessageCreate },
+	{ "READY", Event::Ready },
+	{ "RESUMED", Event::Resumed },
+	{ "GUILD_CREATE", Event::GuildCreate },
+	{ "GUILD_UPDATE", Event::GuildUpdate },
+	{ "GUILD_DELETE", Event::GuildDelete },
+	{ "GUILD_MEMBER_ADD", Event::GuildMemberAdd },
+	{ "GUILD_MEMBER_UPDATE", Event::GuildMemberUpdate },
+	{ "GUILD_MEMBER_REMOVE", Event::GuildMemberRemove },
+	{ "GUILD_MEMBERS_CHUNK", Event::GuildMembersChunk },
+	{ "GUILD_ROLE_CREATE", Event::GuildRoleCreate },
+	{ "GUILD_ROLE_UPDATE", Event::GuildRoleUpdate },
+	{ "GUILD_ROLE_DELETE", Event::GuildRoleDelete },
+	{ "CHANNEL_CREATE", Event::ChannelCreate },
+	{ "CHANNEL_UPDATE", Event::ChannelUpdate },
+	{ "CHANNEL_DELETE", Event::ChannelDelete }
+};
+
+GatewayHandler::Event GatewayHandler::get_event(const std::string &event_name) {
+	auto it = event_table.find(event_name);
+	return it == event_table.end() ? Event::Unhandled : it->second;
+}
+
+GatewayHandler::Event GatewayHandler::dispatch_event(const std::string &event_name) {
+	Event event = get_event(event_name);
+	if (event == Event::PresenceUpdate && !config.cache_presences) {
+		return Event::Unhandled;
+	}
+	return event;
+}
+
+/* worker_threads of 0 shares the cores between the shards in this process */
+static int pipeline_threads(const BotConfig &config) {
+	if (config.worker_threads > 0) {
+		return config.worker_threads;
+	}
+
+	int shards = config.shard_last - config.shard_first + 1;
+	return std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / shards);
+}
+
+GatewayHandler::GatewayHandler(BotConfig &c, ShardManager *manager, int shard_id) : config(c), shard_manager(manager), shard_id(shard_id), pipeline(pipeline_threads(c)) {
 	last_seq = 0;
+	heartbeat_interval = 0;
+	heartbeat_acked = true;
+	zombie_connections = 0;
+	users_evicted = 0;
+	snapshot_stopping = false;
+	snapshot_guilds_loaded = snapshots_written = 0;
+	snapshot_size = 0;
+	snapshot_serialise_ms = snapshot_write_ms = 0;
+	cache_epoch = 0;
+	member_fetches = 0;
+	views_copied = views_reused = 0;
+
+	if (!config.cache_presences) {
+		skipped_guild_lists.push_back("presences");
+	}
+	if (config.cache_members == BotConfig::MemberCaching::OnDemand) {
+		skipped_guild_lists.push_back("members");
+	}
 
-	CommandHelper::init();
+	if (!config.snapshot_file.empty()) {
+		load_snapshot();
+		if (config.snapshot_interval > 0) {
+			snapshot_thread = std::thread(&GatewayHandler::run_snapshots, this);
+		}
+	}
 }
 
-void GatewayHandler::handle_data(std::string data, client &c, websocketpp::connection_hdl &hdl) {
-	json decoded = json::parse(data);
+GatewayHandler::~GatewayHandler() {
+	{
+		std::unique_lock<std::mutex> lock(member_fetches_mutex);
+		member_fetches_cv.wait(lock, [this]() { return member_fetches == 0; });
+	}
+	stop_snapshots();
+}
+
+void GatewayHandler::handle_data(std::string &&data, client &c, websocketpp::connection_hdl &hdl) {
+	auto received = std::chrono::steady_clock::now();
+
+	// dispatches are parsed by the pipeline, everything else is small and handled here on the io thread
+	std::string event_name;
+	if (peek_event_name(data, event_name)) {
+		std::shared_ptr<Dispatch> dispatch = std::make_shared<Dispatch>();
+		dispatch->raw = std::move(data);
+		dispatch->name = event_name;
+		dispatch->event = dispatch_event(event_name);
+		dispatch->received = received;
 
+		submit_dispatch(dispatch, c, hdl);
+		return;
+	}
+
+	json decoded = json::parse(data);
 	int op = decoded["op"];
 
 	switch (op) {
-	case 0: // Event dispatch
-		on_dispatch(decoded, c, hdl);
+	case 0: { // Event dispatch, which didn't start with the event name
+		std::shared_ptr<Dispatch> dispatch = std::make_shared<Dispatch>();
+		dispatch->name = decoded["t"];
+		dispatch->event = dispatch_event(dispatch->name);
+		dispatch->received = received;
+		dispatch->decoded = std::move(decoded);
+
+		submit_dispatch(dispatch, c, hdl);
+		break;
+	}
+	case 1: // Heartbeat request
+		send_heartbeat(c, hdl);
+		break;
+	case 7: // Reconnect
+		on_reconnect(c, hdl);
+		break;
+	case 9: // Invalid Session
+		on_invalid_session(decoded, c, hdl);
 		break;
 	case 10: // Hello
 		on_hello(decoded, c, hdl);
 		break;
-	case 11:
-		Logger::write("Heartbeat acknowledged", Logger::LogLevel::Debug);
+	case 11: // Heartbeat ACK
+		on_heartbeat_ack();
 		break;
 	}
 }
 
-void GatewayHandler::send_heartbeat(client *c, websocketpp::connection_hdl hdl, int interval) {
-	while (true) {
-		boost::this_thread::sleep(boost::posix_time::milliseconds(interval));
-		if (!c) {
-			Logger::write("[send_heartbeat] Client pointer is null", Logger::LogLevel::Severe);
-			break;
-		}
-		else if (c->stopped()) {
-			break;
-		}
+void GatewayHandler::send_heartbeat(client &c, websocketpp::connection_hdl &hdl) {
+	json heartbeat = {
+		{ "op", 1 },
+		{ "d", last_seq.load() }
+	};
 
+	send_queue.push(c, hdl, heartbeat.dump(), GatewayQueue::Priority::High);
 
-		json heartbeat = {
-			{ "op", 1 },
-			{ "d", last_seq }
-		};
+	heartbeat_acked = false;
+	heartbeat_sent = std::chrono::steady_clock::now();
 
-		c->send(hdl, heartbeat.dump(), websocketpp::frame::opcode::text);
+	Logger::write("Sent heartbeat (seq: " + std::to_string(last_seq) + ")", Logger::LogLevel::Debug);
+}
 
-		Logger::write("Sent heartbeat (seq: " + std::to_string(last_seq) + ")", Logger::LogLevel::Debug);
+void GatewayHandler::send_identify(client &c, websocketpp::connection_hdl &hdl) {
+	// the identify limit is shared by every shard, so a reconnecting shard can't identify alongside the others
+	long wait = shard_manager ? static_cast<long>(shard_manager->reserve_identify().count()) : 0;
+	if (wait == 0) {
+		queue_identify(c, hdl);
+		return;
 	}
+
+	Logger::write("Waiting " + std::to_string(wait) + "ms to identify", Logger::LogLevel::Debug);
+	identify_timer = c.set_timer(wait, [this, &c, hdl](const websocketpp::lib::error_code &ec) mutable {
+		if (ec) return;
+		queue_identify(c, hdl);
+	});
 }
 
-void GatewayHandler::send_identify(client &c, websocketpp::connection_hdl &hdl) {
+void GatewayHandler::queue_identify(client &c, websocketpp::connection_hdl &hdl) {
 	json identify = {
 		{ "op", 2 },
 		{ "d", {
@@ -66,13 +272,28 @@ void GatewayHandler::send_identify(client &c, websocketpp::connection_hdl &hdl)
 				{ "$referring_domain", "" }
 			} },
 			{ "compress", false },
-			{ "large_threshold", 250 },
-			{ "shard",{ 0, 1 } }
+			{ "large_threshold", config.large_threshold },
+			{ "shard",{ shard_id, config.shard_count } }
+		} }
+	};
+
+	send_queue.push(c, hdl, identify.dump(), GatewayQueue::Priority::High, [this]() {
+		Logger::write("Sent identify payload (shard " + std::to_string(shard_id) + "/" + std::to_string(config.shard_count) + ")", Logger::LogLevel::Debug);
+	});
+}
+
+void GatewayHandler::send_resume(client &c, websocketpp::connection_hdl &hdl) {
+	json resume = {
+		{ "op", 6 },
+		{ "d", {
+			{ "token", config.token },
+			{ "session_id", get_session_id() },
+			{ "seq", last_seq.load() }
 		} }
 	};
 
-	c.send(hdl, identify.dump(), websocketpp::frame::opcode::text);
-	Logger::write("Sent identify payload", Logger::LogLevel::Debug);
+	send_queue.push(c, hdl, resume.dump(), GatewayQueue::Priority::High);
+	Logger::write("Sent resume payload (session " + get_session_id() + ", seq " + std::to_string(last_seq) + ")", Logger::LogLevel::Debug);
 }
 
 void GatewayHandler::send_request_guild_members(client &c, websocketpp::connection_hdl &hdl, std::string guild_id) {
@@ -85,230 +306,1133 @@ void GatewayHandler::send_request_guild_members(client &c, websocketpp::connecti
 		} }
 	};
 
-	c.send(hdl, request_guild_members.dump(), websocketpp::frame::opcode::text);
+	send_queue.push(c, hdl, request_guild_members.dump(), GatewayQueue::Priority::Normal);
 	Logger::write("Requested guild members for " + guild_id, Logger::LogLevel::Debug);
 }
 
-void GatewayHandler::on_hello(json decoded, client &c, websocketpp::connection_hdl &hdl) {
+void GatewayHandler::request_member_list(DiscordObjects::Guild &guild, client &c, websocketpp::connection_hdl &hdl) {
+	if (config.member_loading == BotConfig::MemberLoading::Off || guild.member_list != DiscordObjects::Guild::MemberList::Partial || guild.unavailable) {
+		return;
+	}
+
+	// the members arrive in chunks, each handled like any other event so messages aren't held up
+	send_request_guild_members(c, hdl, guild.id);
+	guild.member_list = DiscordObjects::Guild::MemberList::Requested;
+}
+
+int GatewayHandler::remove_guild_members(DiscordObjects::Guild &guild) {
+	int users_removed = 0;
+	for (DiscordObjects::GuildMember *member : guild.members) {
+		auto user_it = users.find(member->user->id);
+		std::vector<uint64_t> &user_guilds = user_it->second.guilds;
+		user_guilds.erase(std::remove(user_guilds.begin(), user_guilds.end(), guild.id), user_guilds.end());
+
+		if (user_guilds.empty()) {
+			users.erase(user_it);
+			users_removed++;
+		}
+	}
+	return users_removed;
+}
+
+DiscordObjects::GuildMember *GatewayHandler::add_guild_member(DiscordObjects::Guild &guild, const json &member) {
+	const json &member_user = member["user"];
+	uint64_t user_id = to_snowflake(member_user["id"]);
+
+	// already a member, e.g. sent again after a reconnect
+	DiscordObjects::GuildMember *guild_member = guild.find_member(user_id);
+	if (guild_member) {
+		guild_member->load_from_json(member);
+		guild_member->roles.clear();
+		for (std::string role_id : array_or_empty(member, "roles")) {
+			guild_member->roles.push_back(&roles[to_snowflake(role_id)]);
+		}
+		update_permissions(guild, *guild_member);
+		return guild_member;
+	}
+
+	auto it = users.find(user_id);
+	if (it == users.end()) { // new user
+		it = users.emplace(user_id, DiscordObjects::User(member_user)).first;
+	}
+	std::vector<uint64_t> &user_guilds = it->second.guilds;
+	if (std::find(user_guilds.begin(), user_guilds.end(), guild.id) == user_guilds.end()) { // guild may have been recreated
+		user_guilds.push_back(guild.id);
+	}
+
+	guild_member = guild.add_member(member, &it->second);
+	for (std::string role_id : array_or_empty(member, "roles")) {
+		guild_member->roles.push_back(&roles[to_snowflake(role_id)]);
+	}
+	update_permissions(guild, *guild_member);
+
+	return guild_member;
+}
+
+void GatewayHandler::update_permissions(const DiscordObjects::Guild &guild, DiscordObjects::GuildMember &member) {
+	const uint32_t all = ~0u;
+
+	auto everyone = roles.find(guild.id);
+	uint32_t permissions = everyone == roles.end() ? 0 : everyone->second.permissions;
+	bool js_allowed = false;
+	for (const DiscordObjects::Role *role : member.roles) {
+		permissions |= role->permissions;
+		js_allowed = js_allowed || config.js_allowed_roles.count(role->name);
+	}
+	if (member.user->id == guild.owner_id || (permissions & static_cast<uint32_t>(DiscordObjects::Permission::Administrator))) {
+		permissions = all;
+	}
+
+	member.permissions = permissions;
+	member.js_allowed = js_allowed;
+}
+
+void GatewayHandler::update_permissions(const DiscordObjects::Guild &guild, uint64_t role_id) {
+	for (DiscordObjects::GuildMember *member : guild.members) {
+		bool has_role = role_id == guild.id || std::find_if(member->roles.begin(), member->roles.end(), [role_id](const DiscordObjects::Role *r) {
+			return r->id == role_id;
+		}) != member->roles.end();
+
+		if (has_role) {
+			update_permissions(guild, *member);
+		}
+	}
+}
+
+bool GatewayHandler::load_member_on_demand(Dispatch &dispatch, client &c, websocketpp::connection_hdl hdl) {
+	const json &message = dispatch.decoded["d"];
+	const json &author = message["author"];
+	if (author.value("bot", false)) return false;
+
+	std::string content = message.value("content", "");
+	std::string command = content.substr(0, content.find(' '));
+	uint64_t user_id = to_snowflake(author["id"]);
+	Snowflake guild_id;
+
+	if (dispatch.member_fetched) {
+		if (dispatch.member.is_null()) return false; // the command will say they couldn't be found
+
+		std::unique_lock<std::shared_timed_mutex> lock(cache_mutex);
+		auto channel_it = channels.find(to_snowflake(message["channel_id"]));
+		if (channel_it == channels.end()) return false; // deleted while fetching
+		auto guild_it = guilds.find(channel_it->second.guild_id);
+		if (guild_it == guilds.end()) return false;
+
+		add_guild_member(guild_it->second, dispatch.member);
+		guild_changed(guild_it->first);
+		touch_user(user_id);
+		evict_users();
+
+		Logger::write("Loaded member " + std::to_string(user_id) + " of guild " + guild_it->second.id + " on demand", Logger::LogLevel::Debug);
+		return false;
+	}
+
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(cache_mutex);
+		auto channel_it = channels.find(to_snowflake(message["channel_id"]));
+		if (channel_it == channels.end()) return false;
+		guild_id = channel_it->second.guild_id;
+
+		auto guild_it = guilds.find(guild_id);
+		if (guild_it == guilds.end()) return false;
+		if (guild_it->second.find_member(user_id)) {
+			touch_user(user_id);
+			return false;
+		}
+	}
+
+	// only the JS and custom commands look at the sender's member object
+	CommandHelper::Command custom_command;
+	if (command != "~js" && command != "~createjs" && !CommandHelper::get_command(guild_id, command, custom_command)) {
+		return false;
+	}
+
+	// the worker isn't held up waiting for the API, the message is handled again once the member arrives
+	std::string author_id = author["id"];
+	std::shared_ptr<Dispatch> waiting = std::make_shared<Dispatch>(std::move(dispatch));
+	{
+		std::lock_guard<std::mutex> lock(member_fetches_mutex);
+		member_fetches++;
+	}
+	DiscordAPI::get_guild_member(guild_id, author_id, config.token, config.cert_location, [this, waiting, &c, hdl, guild_id = guild_id.str()](json member) {
+		waiting->member = std::move(member);
+		waiting->member_fetched = true;
+		pipeline.submit(
+			[]() {},
+			[guild_id]() { return guild_id; },
+			[this, waiting, &c, hdl]() mutable {
+				on_dispatch(*waiting, c, hdl);
+			}
+		);
+
+		std::lock_guard<std::mutex> lock(member_fetches_mutex);
+		member_fetches--;
+		member_fetches_cv.notify_all();
+	});
+	return true;
+}
+
+void GatewayHandler::touch_user(uint64_t user_id) {
+	if (config.max_users == 0) return;
+
+	std::lock_guard<std::mutex> lock(lru_mutex);
+	auto it = user_lru_index.find(user_id);
+	if (it != user_lru_index.end()) {
+		user_lru.splice(user_lru.begin(), user_lru, it->second);
+	}
+	else {
+		user_lru.push_front(user_id);
+		user_lru_index[user_id] = user_lru.begin();
+	}
+}
+
+void GatewayHandler::evict_users() {
+	if (config.max_users == 0) return;
+
+	std::lock_guard<std::mutex> lock(lru_mutex);
+	while (user_lru.size() > static_cast<size_t>(config.max_users)) {
+		uint64_t user_id = user_lru.back();
+		user_lru.pop_back();
+		user_lru_index.erase(user_id);
+
+		// may already be gone, e.g. after leaving their guilds
+		auto it = users.find(user_id);
+		if (it == users.end()) continue;
+
+		for (uint64_t guild_id : it->second.guilds) {
+			auto guild_it = guilds.find(guild_id);
+			if (guild_it != guilds.end()) {
+				guild_it->second.remove_member(user_id);
+				guild_changed(guild_id);
+			}
+		}
+		users.erase(it);
+		users_evicted++;
+	}
+}
+
+std::string GatewayHandler::allocator_stats_string() {
+	size_t live = 0, free = 0, chunks = 0, bytes = 0;
+	for (auto &g : guilds) {
+		const Slab<DiscordObjects::GuildMember> &slab = g.second.member_slab;
+		live += slab.live();
+		free += slab.free();
+		chunks += slab.chunk_count();
+		bytes += slab.memory_usage();
+	}
+
+	return "**__Allocators (shard " + std::to_string(shard_id) + ")__**"
+		+ "\n**guilds:** " + guilds.stats_string()
+		+ "\n**channels:** " + channels.stats_string()
+		+ "\n**roles:** " + roles.stats_string()
+		+ "\n**users:** " + users.stats_string()
+		+ "\n**guild members:** " + std::to_string(live) + " live, " + std::to_string(free) + " free in " + std::to_string(chunks)
+			+ " chunk(s) across " + std::to_string(guilds.size()) + " guild slabs (" + std::to_string(bytes / 1024) + " KB)"
+		+ "\n**interned strings (all shards):** " + InternedString::stats_string()
+		+ guild_view_stats_string()
+		+ cache_policy_string();
+}
+
+std::unordered_map<uint64_t, size_t> GatewayHandler::trivia_memory_usage() {
+	std::unordered_map<uint64_t, size_t> usage;
+
+	std::lock_guard<std::recursive_mutex> lock(games_mutex);
+	for (auto &game : games) {
+		auto it = channels.find(to_snowflake(game.first));
+		if (it != channels.end()) {
+			usage[it->second.guild_id] += game.second->memory_usage();
+		}
+	}
+	return usage;
+}
+
+MemoryUsage::GuildMemory GatewayHandler::guild_memory_usage(const DiscordObjects::Guild &guild, const std::unordered_map<uint64_t, size_t> &trivia) {
+	MemoryUsage::GuildMemory memory = MemoryUsage::guild_memory(guild);
+
+	auto v8_it = v8_instances.find(guild.id.str());
+	if (v8_it != v8_instances.end()) {
+		memory.v8_heap = v8_it->second->heap_total();
+		memory.v8_heap_used = v8_it->second->heap_used();
+	}
+
+	auto trivia_it = trivia.find(guild.id);
+	if (trivia_it != trivia.end()) {
+		memory.trivia = trivia_it->second;
+	}
+
+	return memory;
+}
+
+std::string GatewayHandler::memory_stats_string() {
+	std::unordered_map<uint64_t, size_t> trivia = trivia_memory_usage();
+
+	MemoryUsage::GuildMemory total;
+	std::vector<std::pair<size_t, const DiscordObjects::Guild *>> largest;
+	for (auto &g : guilds) {
+		MemoryUsage::GuildMemory memory = guild_memory_usage(g.second, trivia);
+		total += memory;
+		largest.emplace_back(memory.total(), &g.second);
+	}
+
+	size_t shown = std::min<size_t>(largest.size(), 10);
+	std::partial_sort(largest.begin(), largest.begin() + shown, largest.end(), [](const std::pair<size_t, const DiscordObjects::Guild *> &a, const std::pair<size_t, const DiscordObjects::Guild *> &b) {
+		return a.first > b.first;
+	});
+
+	// the maps' slots are counted against the guilds, what's left is free slots, padding and the indexes
+	size_t storage = guilds.memory_usage() + channels.memory_usage() + users.memory_usage() + roles.memory_usage();
+	size_t live_slots = guilds.size() * sizeof(std::pair<const uint64_t, DiscordObjects::Guild>) + channels.size() * sizeof(std::pair<const uint64_t, DiscordObjects::Channel>)
+		+ users.size() * sizeof(std::pair<const uint64_t, DiscordObjects::User>) + roles.size() * sizeof(std::pair<const uint64_t, DiscordObjects::Role>);
+	// channel_guilds is left out, it belongs to route_dispatch which doesn't take cache_mutex
+	size_t lru;
+	{
+		std::lock_guard<std::mutex> lock(lru_mutex);
+		lru = MemoryUsage::heap_bytes(user_lru_index) + user_lru.size() * (sizeof(uint64_t) + 2 * sizeof(void *));
+	}
+
+	std::string output = "**__Memory (shard " + std::to_string(shard_id) + ")__**"
+		+ "\n**guilds (" + std::to_string(guilds.size()) + "):** " + total.to_string()
+		+ "\n**cache storage:** " + std::to_string(storage / 1024) + " KB, " + std::to_string((storage - std::min(storage, live_slots)) / 1024) + " KB not in a guild's figures"
+		+ "\n**user LRU:** " + std::to_string(lru / 1024) + " KB"
+		+ "\n**interned string pool (all shards):** " + std::to_string(InternedString::pool_memory_usage() / 1024) + " KB"
+		+ "\n**largest guilds:**";
+	for (size_t i = 0; i < shown; i++) {
+		output += "\n" + largest[i].second->id + " (" + largest[i].second->name + "): " + std::to_string(largest[i].first / 1024) + " KB";
+	}
+
+	return output;
+}
+
+std::string GatewayHandler::memory_stats_string(const DiscordObjects::Guild &guild) {
+	MemoryUsage::GuildMemory memory = guild_memory_usage(guild, trivia_memory_usage());
+
+	return "**__Memory (guild " + guild.id + ")__**"
+		+ "\n**name:** " + guild.name
+		+ "\n**total:** " + std::to_string(memory.total() / 1024) + " KB"
+		+ "\n**guild:** " + std::to_string(memory.guild / 1024) + " KB"
+		+ "\n**channels (" + std::to_string(guild.channels.size()) + "):** " + std::to_string(memory.channels / 1024) + " KB"
+		+ "\n**roles (" + std::to_string(guild.roles.size()) + "):** " + std::to_string(memory.roles / 1024) + " KB"
+		+ "\n**members (" + std::to_string(guild.members.size()) + "):** " + std::to_string(memory.members / 1024) + " KB"
+		+ "\n**users (share):** " + std::to_string(memory.users / 1024) + " KB"
+		+ "\n**v8 heap:** " + std::to_string(memory.v8_heap / 1024) + " KB (" + std::to_string(memory.v8_heap_used / 1024) + " KB used)"
+		+ "\n**trivia:** " + std::to_string(memory.trivia / 1024) + " KB";
+}
+
+json GatewayHandler::memory_report() {
+	std::unordered_map<uint64_t, size_t> trivia = trivia_memory_usage();
+
+	MemoryUsage::GuildMemory total;
+	json guild_reports = json::array();
+	for (auto &g : guilds) {
+		MemoryUsage::GuildMemory memory = guild_memory_usage(g.second, trivia);
+		total += memory;
+		guild_reports.push_back({
+			{ "id", g.second.id.str() },
+			{ "name", g.second.name },
+			{ "channels", g.second.channels.size() },
+			{ "roles", g.second.roles.size() },
+			{ "members", g.second.members.size() },
+			{ "bytes", memory.to_json() }
+		});
+	}
+
+	return {
+		{ "shard_id", shard_id },
+		{ "created_unix_ms", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() },
+		{ "total", total.to_json() },
+		{ "cache_storage", guilds.memory_usage() + channels.memory_usage() + users.memory_usage() + roles.memory_usage() },
+		{ "interned_string_pool", InternedString::pool_memory_usage() },
+		{ "guilds", guild_reports }
+	};
+}
+
+std::string GatewayHandler::memory_report_path() {
+	return "memory." + std::to_string(shard_id) + ".json";
+}
+
+std::string GatewayHandler::cache_policy_string() {
+	std::string members = "all";
+	if (config.cache_members == BotConfig::MemberCaching::OnDemand) {
+		std::lock_guard<std::mutex> lock(lru_mutex);
+		members = "on demand, " + (config.max_users == 0 ? "no user limit" : std::to_string(user_lru.size()) + "/" + std::to_string(config.max_users)
+			+ " users, " + std::to_string(users_evicted) + " evicted");
+	}
+
+	return "\n**cache policy:** presences " + std::string(config.cache_presences ? "on" : "off")
+		+ ", members " + members
+		+ ", channels " + (config.cache_voice_channels ? "all" : "text only");
+}
+
+std::string GatewayHandler::snapshot_path() {
+	return config.snapshot_file + "." + std::to_string(shard_id);
+}
+
+void GatewayHandler::load_snapshot() {
+	std::string path = snapshot_path();
+	auto start = std::chrono::steady_clock::now();
+
+	CacheSnapshot::Reader reader(path);
+	if (!reader.is_open()) {
+		Logger::write("[snapshot] No usable snapshot at " + path + " (version " + std::to_string(CacheSnapshot::version) + "), starting with empty caches", Logger::LogLevel::Info);
+		return;
+	}
+	if (reader.shard_id != static_cast<uint32_t>(shard_id) || reader.shard_count != static_cast<uint32_t>(config.shard_count)) {
+		Logger::write("[snapshot] " + path + " is of shard " + std::to_string(reader.shard_id) + "/" + std::to_string(reader.shard_count) + ", ignoring it", Logger::LogLevel::Warning);
+		return;
+	}
+
+	if (!reader.load(guilds, channels, users, roles)) {
+		guilds.clear();
+		channels.clear();
+		users.clear();
+		roles.clear();
+		return;
+	}
+
+	for (auto &g : guilds) {
+		DiscordObjects::Guild &guild = g.second;
+		for (DiscordObjects::Channel *channel : guild.channels) {
+			channel_guilds[channel->id.str()] = guild.id.str();
+			guild_routed_channels[guild.id.str()].push_back(channel->id.str());
+		}
+		v8_instances[guild.id] = std::make_unique<V8Instance>(config, guild.id);
+		update_permissions(guild, guild.id);
+	}
+	if (config.cache_members == BotConfig::MemberCaching::OnDemand) {
+		for (auto &u : users) {
+			touch_user(u.first);
+		}
+		evict_users();
+	}
+	snapshot_guilds_loaded = guilds.size();
+
+	long age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - reader.created_unix_ms / 1000;
+	long took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	Logger::write("[snapshot] Loaded " + std::to_string(guilds.size()) + " guilds, " + std::to_string(channels.size()) + " channels, " + std::to_string(roles.size()) + " roles and "
+		+ std::to_string(users.size()) + " users from " + path + " (" + std::to_string(age) + "s old) in " + std::to_string(took) + "ms", Logger::LogLevel::Info);
+}
+
+void GatewayHandler::write_snapshot() {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint64_t> guild_ids;
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(cache_mutex);
+		if (guilds.empty()) return; // e.g. shutting down before READY, which shouldn't replace the last snapshot
+		guild_ids.reserve(guilds.size());
+		for (auto &g : guilds) {
+			guild_ids.push_back(g.first);
+		}
+	}
+
+	// a guild at a time, so events waiting for the exclusive lock are only held up by one guild rather than the whole cache
+	CacheSnapshot::Writer writer;
+	for (uint64_t guild_id : guild_ids) {
+		std::shared_lock<std::shared_timed_mutex> lock(cache_mutex);
+		auto it = guilds.find(guild_id);
+		if (it != guilds.end()) { // may have been deleted since
+			writer.add_guild(it->second);
+		}
+	}
+	std::string snapshot = writer.finish(shard_id, config.shard_count);
+	auto serialised = std::chrono::steady_clock::now();
+
+	if (!CacheSnapshot::write_file(snapshot_path(), snapshot)) return;
+
+	std::lock_guard<std::mutex> lock(snapshot_mutex);
+	snapshots_written++;
+	snapshot_written_at = std::chrono::system_clock::now();
+	snapshot_size = snapshot.length();
+	snapshot_serialise_ms = std::chrono::duration_cast<std::chrono::milliseconds>(serialised - start).count();
+	snapshot_write_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - serialised).count();
+
+	Logger::write("[snapshot] Wrote " + std::to_string(snapshot_size / 1024) + " KB to " + snapshot_path() + " (" + std::to_string(snapshot_serialise_ms) + "ms serialising, "
+		+ std::to_string(snapshot_write_ms) + "ms writing)", Logger::LogLevel::Debug);
+}
+
+void GatewayHandler::run_snapshots() {
+	std::unique_lock<std::mutex> lock(snapshot_mutex);
+	while (!snapshot_cv.wait_for(lock, std::chrono::seconds(config.snapshot_interval), [this]() { return snapshot_stopping; })) {
+		lock.unlock();
+		write_snapshot();
+		lock.lock();
+	}
+}
+
+void GatewayHandler::stop_snapshots() {
+	{
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		snapshot_stopping = true;
+	}
+	snapshot_cv.notify_all();
+
+	if (snapshot_thread.joinable()) {
+		snapshot_thread.join();
+	}
+}
+
+std::string GatewayHandler::snapshot_stats_string() {
+	if (config.snapshot_file.empty()) {
+		return "\n**snapshot:** off";
+	}
+
+	int not_refreshed = 0;
+	for (auto &g : guilds) {
+		not_refreshed += g.second.from_snapshot;
+	}
+
+	std::lock_guard<std::mutex> lock(snapshot_mutex);
+	std::string written = "none written yet";
+	if (snapshots_written > 0) {
+		long age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - snapshot_written_at).count();
+		written = std::to_string(snapshots_written) + " written, last " + std::to_string(age) + "s ago (" + std::to_string(snapshot_size / 1024) + " KB, "
+			+ std::to_string(snapshot_serialise_ms) + "ms serialising, " + std::to_string(snapshot_write_ms) + "ms writing)";
+	}
+
+	return "\n**snapshot:** " + std::to_string(snapshot_guilds_loaded) + " guilds loaded at startup, " + std::to_string(not_refreshed) + " not sent again yet, " + written;
+}
+
+void GatewayHandler::guild_changed(uint64_t guild_id) {
+	auto it = guilds.find(guild_id);
+	if (it != guilds.end()) {
+		it->second.view_epoch = ++cache_epoch;
+	}
+}
+
+void GatewayHandler::user_changed(const DiscordObjects::User &user) {
+	// views copy the users of the guild's members
+	for (uint64_t guild_id : user.guilds) {
+		guild_changed(guild_id);
+	}
+}
+
+void GatewayHandler::event_changed_guilds(Event event, const json &data) {
+	switch (event) {
+	case Event::PresenceUpdate: {
+		auto it = users.find(to_snowflake(data["user"].value("id", "")));
+		if (it != users.end()) {
+			user_changed(it->second);
+		}
+		break;
+	}
+	case Event::Ready: // guilds left since the snapshot are deleted, with their views
+	case Event::Resumed:
+		break;
+	case Event::GuildCreate:
+	case Event::GuildUpdate:
+	case Event::GuildDelete:
+		guild_changed(to_snowflake(data.value("id", "")));
+		break;
+	default:
+		guild_changed(to_snowflake(data.value("guild_id", "")));
+		break;
+	}
+}
+
+std::shared_ptr<GuildView> GatewayHandler::get_guild_view(const DiscordObjects::Guild &guild) {
+	uint64_t epoch = guild.view_epoch;
+	{
+		std::lock_guard<std::mutex> lock(views_mutex);
+		auto it = guild_views.find(guild.id);
+		if (it != guild_views.end() && it->second->epoch == epoch) {
+			views_reused++;
+			return it->second;
+		}
+	}
+
+	// copied without views_mutex, so other guilds' readers aren't held up. The guild can't change while cache_mutex is held.
+	std::shared_ptr<GuildView> view = std::make_shared<GuildView>(guild, epoch);
+
+	std::lock_guard<std::mutex> lock(views_mutex);
+	guild_views[guild.id] = view;
+	views_copied++;
+	return view;
+}
+
+std::string GatewayHandler::guild_view_stats_string() {
+	std::lock_guard<std::mutex> lock(views_mutex);
+	return "\n**guild views:** " + std::to_string(guild_views.size()) + " published at epoch " + std::to_string(cache_epoch) + ", "
+		+ std::to_string(views_copied) + " copied, " + std::to_string(views_reused) + " reused";
+}
+
+std::string GatewayHandler::member_list_stats_string() {
+	int complete = 0, partial = 0;
+	std::string loading;
+
+	for (auto &g : guilds) {
+		const DiscordObjects::Guild &guild = g.second;
+		switch (guild.member_list) {
+		case DiscordObjects::Guild::MemberList::Complete:
+			complete++; break;
+		case DiscordObjects::Guild::MemberList::Partial:
+			partial++; break;
+		case DiscordObjects::Guild::MemberList::Requested:
+			loading += "\n:small_orange_diamond: " + guild.id + ": " + std::to_string(guild.members.size()) + "/" + std::to_string(guild.member_count);
+			break;
+		}
+	}
+
+	return "\n**member lists:** " + std::to_string(complete) + " complete, " + std::to_string(partial) + " partial" + loading;
+}
+
+void GatewayHandler::on_hello(const json &decoded, client &c, websocketpp::connection_hdl &hdl) {
 	heartbeat_interval = decoded["d"]["heartbeat_interval"];
 
 	Logger::write("Heartbeat interval: " + std::to_string(heartbeat_interval / 1000.0f) + " seconds", Logger::LogLevel::Debug);
 
-	heartbeat_thread = std::make_unique<boost::thread>(boost::bind(&GatewayHandler::send_heartbeat, this, &c, hdl, heartbeat_interval));
+	heartbeat_acked = true;
+	schedule_heartbeat(c, hdl);
+
+	if (get_session_id().empty()) {
+		send_identify(c, hdl);
+	}
+	else {
+		send_resume(c, hdl);
+	}
+}
+
+void GatewayHandler::schedule_heartbeat(client &c, websocketpp::connection_hdl hdl) {
+	heartbeat_timer = c.set_timer(heartbeat_interval, [this, &c, hdl](const websocketpp::lib::error_code &ec) {
+		if (!ec) {
+			on_heartbeat_timer(c, hdl);
+		}
+	});
+}
+
+void GatewayHandler::on_heartbeat_timer(client &c, websocketpp::connection_hdl hdl) {
+	if (!heartbeat_acked) {
+		// no ACK for a whole interval, the connection is probably dead without having been closed.
+		// 4xxx close code so the session is resumed.
+		zombie_connections++;
+		Logger::write("Heartbeat ACK not received, reconnecting", Logger::LogLevel::Warning);
 
-	send_identify(c, hdl);
+		websocketpp::lib::error_code ec;
+		c.close(hdl, 4000, "Heartbeat ACK not received", ec);
+		return;
+	}
+
+	send_heartbeat(c, hdl);
+	schedule_heartbeat(c, hdl);
+}
+
+void GatewayHandler::on_heartbeat_ack() {
+	if (heartbeat_acked) {
+		Logger::write("Unexpected heartbeat ACK", Logger::LogLevel::Debug);
+		return;
+	}
+	heartbeat_acked = true;
+
+	long rtt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - heartbeat_sent).count();
+	{
+		std::lock_guard<std::mutex> lock(session_mutex);
+		heartbeat_latency.record(rtt);
+	}
+
+	Logger::write("Heartbeat acknowledged (" + std::to_string(rtt) + "ms)", Logger::LogLevel::Debug);
+}
+
+std::string GatewayHandler::get_session_id() {
+	std::lock_guard<std::mutex> lock(session_mutex);
+	return session_id;
 }
 
-void GatewayHandler::on_dispatch(json decoded, client &c, websocketpp::connection_hdl &hdl) {
-	last_seq = decoded["s"];
-	std::string event_name = decoded["t"];
-	json data = decoded["d"];
+void GatewayHandler::set_session_id(std::string id) {
+	std::lock_guard<std::mutex> lock(session_mutex);
+	session_id = id;
+}
 
-	if (event_name == "READY") {
-		on_event_ready(data);
+std::string GatewayHandler::gateway_stats_string() {
+	std::string session = get_session_id();
+	std::string rtt;
+	{
+		std::lock_guard<std::mutex> lock(session_mutex);
+		rtt = heartbeat_latency.to_string("ms");
 	}
-	else if (event_name == "GUILD_CREATE") {
-		on_event_guild_create(data);
+
+	return "**__Gateway (shard " + std::to_string(shard_id) + "/" + std::to_string(config.shard_count) + ")__**"
+		+ "\n**session:** " + (session.empty() ? "none" : session)
+		+ "\n**last_seq:** " + std::to_string(last_seq)
+		+ "\n**heartbeat_interval:** " + std::to_string(heartbeat_interval) + "ms"
+		+ "\n**heartbeat RTT:** " + rtt
+		+ "\n**zombie connections:** " + std::to_string(zombie_connections)
+		+ send_queue.stats_string()
+		+ member_list_stats_string()
+		+ snapshot_stats_string()
+		+ HTTP::stats_string()
+		+ DiscordAPI::stats_string();
+}
+
+void GatewayHandler::on_reconnect(client &c, websocketpp::connection_hdl &hdl) {
+	Logger::write("Gateway requested a reconnect", Logger::LogLevel::Info);
+
+	// 1000 and 1001 would end the session, any 4xxx code keeps it resumable
+	websocketpp::lib::error_code ec;
+	c.close(hdl, 4000, "Reconnect requested", ec);
+}
+
+void GatewayHandler::on_invalid_session(const json &decoded, client &c, websocketpp::connection_hdl &hdl) {
+	bool resumable = decoded.value("d", false);
+
+	Logger::write("Invalid session (resumable: " + std::to_string(resumable) + ")", Logger::LogLevel::Warning);
+	if (!resumable) {
+		set_session_id("");
+		last_seq = 0;
 	}
-	else if (event_name == "GUILD_UPDATE") {
-		on_event_guild_update(data);
+
+	// Discord asks for a random wait of 1-5 seconds before identifying again
+	std::random_device rd;
+	std::uniform_int_distribution<long> dist(1000, 5000);
+
+	identify_timer = c.set_timer(dist(rd), [this, &c, hdl](const websocketpp::lib::error_code &ec) mutable {
+		if (ec) return;
+
+		if (get_session_id().empty()) {
+			send_identify(c, hdl);
+		}
+		else {
+			send_resume(c, hdl);
+		}
+	});
+}
+
+bool GatewayHandler::on_disconnect(int close_code) {
+	if (heartbeat_timer) {
+		heartbeat_timer->cancel();
+		heartbeat_timer.reset();
 	}
-	else if (event_name == "GUILD_DELETE") {
-		on_event_guild_delete(data);
+	if (identify_timer) {
+		identify_timer->cancel();
+		identify_timer.reset();
 	}
-	else if (event_name == "GUILD_MEMBER_ADD") {
-		on_event_guild_member_add(data);
+	send_queue.clear();
+
+	std::unique_lock<std::shared_timed_mutex> lock(cache_mutex);
+	// queued requests were dropped and chunks may have been lost, so these have to be requested again
+	for (auto &g : guilds) {
+		if (g.second.member_list == DiscordObjects::Guild::MemberList::Requested) {
+			g.second.member_list = DiscordObjects::Guild::MemberList::Partial;
+			g.second.view_epoch = ++cache_epoch;
+		}
 	}
-	else if (event_name == "GUILD_MEMBER_UPDATE") {
-		on_event_guild_member_update(data);
+
+	switch (close_code) {
+	case 4004: // authentication failed
+	case 4010: // invalid shard
+	case 4011: // sharding required
+	case 4012: // invalid API version
+		Logger::write("Gateway closed with code " + std::to_string(close_code) + ", not reconnecting", Logger::LogLevel::Severe);
+		return false;
+	case 4007: // invalid seq
+	case 4009: // session timed out
+		set_session_id("");
+		last_seq = 0;
+		break;
 	}
-	else if (event_name == "GUILD_MEMBER_REMOVE") {
-		on_event_guild_member_remove(data);
+
+	return true;
+}
+
+void GatewayHandler::submit_dispatch(std::shared_ptr<Dispatch> dispatch, client &c, websocketpp::connection_hdl hdl) {
+	pipeline.submit(
+		[this, dispatch]() {
+			if (!dispatch->decoded.is_null()) return;
+
+			if (dispatch->event == Event::Unhandled) {
+				dispatch->decoded = json::parse(dispatch->raw, skip_payload);
+			}
+			else if (dispatch->event == Event::GuildCreate && !skipped_guild_lists.empty()) {
+				dispatch->decoded = json::parse(dispatch->raw, skip_lists(skipped_guild_lists));
+			}
+			else {
+				dispatch->decoded = json::parse(dispatch->raw);
+			}
+			std::string().swap(dispatch->raw);
+		},
+		[this, dispatch]() {
+			return route_dispatch(*dispatch);
+		},
+		[this, dispatch, &c, hdl]() mutable {
+			on_dispatch(*dispatch, c, hdl);
+		}
+	);
+}
+
+std::string GatewayHandler::route_dispatch(const Dispatch &dispatch) {
+	last_seq = dispatch.decoded["s"].get<int>();
+
+	if (dispatch.event == Event::Unhandled) {
+		return ""; // "d" may not have been parsed
 	}
-	else if (event_name == "GUILD_ROLE_CREATE") {
-		on_event_guild_role_create(data);
+	const json &data = dispatch.decoded["d"];
+
+	switch (dispatch.event) {
+	case Event::MessageCreate: {
+		// messages don't say which guild they are in, DMs have no guild at all
+		auto it = channel_guilds.find(data.value("channel_id", ""));
+		return it == channel_guilds.end() ? "" : it->second;
 	}
-	else if (event_name == "GUILD_ROLE_UPDATE") {
-		on_event_guild_role_update(data);
+	case Event::GuildCreate: {
+		// channels deleted since the guild was last sent aren't listed, so none of the old ones are kept
+		std::string guild_id = data["id"];
+		unroute_guild(guild_id);
+		std::vector<std::string> &routed = guild_routed_channels[guild_id];
+		for (const json &channel : array_or_empty(data, "channels")) {
+			channel_guilds[channel["id"]] = guild_id;
+			routed.push_back(channel["id"]);
+		}
+		return guild_id;
 	}
-	else if (event_name == "GUILD_ROLE_DELETE") {
-		on_event_guild_role_delete(data);
+	case Event::GuildUpdate:
+		return data.value("id", "");
+	case Event::GuildDelete:
+		if (!data.value("unavailable", false)) {
+			unroute_guild(data["id"]);
+		}
+		return data.value("id", "");
+	case Event::ChannelCreate:
+		if (data.count("guild_id")) {
+			channel_guilds[data["id"]] = data["guild_id"];
+			guild_routed_channels[data["guild_id"]].push_back(data["id"]);
+		}
+		return data.value("guild_id", "");
+	case Event::ChannelDelete:
+		channel_guilds.erase(data.value("id", ""));
+		return data.value("guild_id", "");
+	default:
+		return data.value("guild_id", "");
 	}
-	else if (event_name == "CHANNEL_CREATE") {
-		on_event_channel_create(data);
+}
+
+void GatewayHandler::unroute_guild(const std::string &guild_id) {
+	auto it = guild_routed_channels.find(guild_id);
+	if (it == guild_routed_channels.end()) return;
+
+	for (const std::string &channel_id : it->second) {
+		auto channel_it = channel_guilds.find(channel_id);
+		// may have been deleted since
+		if (channel_it != channel_guilds.end() && channel_it->second == guild_id) {
+			channel_guilds.erase(channel_it);
+		}
 	}
-	else if (event_name == "CHANNEL_UPDATE") {
-		on_event_channel_update(data);
+	guild_routed_channels.erase(it);
+}
+
+void GatewayHandler::on_dispatch(Dispatch &dispatch, client &c, websocketpp::connection_hdl &hdl) {
+	if (dispatch.event == Event::Unhandled) {
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		unhandled_event_counts[dispatch.name]++;
+		event_latency[static_cast<size_t>(Event::Unhandled)].record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - dispatch.received).count());
+		return;
 	}
-	else if (event_name == "CHANNEL_DELETE") {
-		on_event_channel_delete(data);
+
+	const json &data = dispatch.decoded["d"];
+
+	// commands only read the caches, so run in parallel with other guilds' commands
+	if (dispatch.event == Event::MessageCreate) {
+		if (config.cache_members == BotConfig::MemberCaching::OnDemand && load_member_on_demand(dispatch, c, hdl)) {
+			return; // taken, and handled again once the sender's member object has been fetched
+		}
+
+		std::function<void()> after_unlock;
+		uint64_t load_members_guild = 0;
+		{
+			std::shared_lock<std::shared_timed_mutex> lock(cache_mutex);
+			on_event_message_create(data, c, hdl, after_unlock, load_members_guild);
+		}
+		if (load_members_guild) {
+			// marking the list as requested changes the guild, which readers of the shared lock could see half done
+			std::unique_lock<std::shared_timed_mutex> lock(cache_mutex);
+			auto it = guilds.find(load_members_guild);
+			if (it != guilds.end()) {
+				request_member_list(it->second, c, hdl);
+				guild_changed(it->first);
+			}
+		}
+		if (after_unlock) {
+			after_unlock();
+		}
 	}
-	else if (event_name == "MESSAGE_CREATE") {
-		on_event_message_create(data, c, hdl);
+	else {
+		std::unique_lock<std::shared_timed_mutex> lock(cache_mutex);
+		handle_cache_event(dispatch.event, data, c, hdl);
+		event_changed_guilds(dispatch.event, data);
 	}
-	else if (event_name == "PRESENCE_UPDATE") {
-		on_event_presence_update(data);
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	event_latency[static_cast<size_t>(dispatch.event)].record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - dispatch.received).count());
+}
+
+void GatewayHandler::handle_cache_event(Event event, const json &data, client &c, websocketpp::connection_hdl &hdl) {
+	switch (event) {
+	case Event::PresenceUpdate:
+		on_event_presence_update(data); break;
+	case Event::Ready:
+		on_event_ready(data); break;
+	case Event::Resumed:
+		on_event_resumed(data); break;
+	case Event::GuildCreate:
+		on_event_guild_create(data, c, hdl); break;
+	case Event::GuildUpdate:
+		on_event_guild_update(data); break;
+	case Event::GuildDelete:
+		on_event_guild_delete(data); break;
+	case Event::GuildMemberAdd:
+		on_event_guild_member_add(data); break;
+	case Event::GuildMemberUpdate:
+		on_event_guild_member_update(data); break;
+	case Event::GuildMemberRemove:
+		on_event_guild_member_remove(data); break;
+	case Event::GuildMembersChunk:
+		on_event_guild_members_chunk(data); break;
+	case Event::GuildRoleCreate:
+		on_event_guild_role_create(data); break;
+	case Event::GuildRoleUpdate:
+		on_event_guild_role_update(data); break;
+	case Event::GuildRoleDelete:
+		on_event_guild_role_delete(data); break;
+	case Event::ChannelCreate:
+		on_event_channel_create(data); break;
+	case Event::ChannelUpdate:
+		on_event_channel_update(data); break;
+	case Event::ChannelDelete:
+		on_event_channel_delete(data); break;
+	case Event::MessageCreate:
+	case Event::Unhandled:
+		break;
 	}
 }
 
-void GatewayHandler::on_event_ready(json data) {
+std::map<std::string, LatencyHistogram> GatewayHandler::get_event_stats() {
+	std::lock_guard<std::mutex> lock(stats_mutex);
+
+	std::map<std::string, LatencyHistogram> stats;
+	for (auto &e : event_table) {
+		stats[e.first] = event_latency[static_cast<size_t>(e.second)];
+	}
+	stats["(unhandled)"] = event_latency[static_cast<size_t>(Event::Unhandled)];
+
+	return stats;
+}
+
+std::string GatewayHandler::event_stats_string() {
+	std::string stats = "**__Gateway events__** (handling time)";
+	for (auto &e : get_event_stats()) {
+		if (e.second.count() > 0) {
+			stats += "\n**" + e.first + ":** " + e.second.to_string("us");
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	for (auto &e : unhandled_event_counts) {
+		stats += "\n:small_orange_diamond: " + e.first + ": " + std::to_string(e.second);
+	}
+
+	return stats;
+}
+
+void GatewayHandler::on_event_ready(const json &data) {
 	user_object.load_from_json(data["user"]);
+	set_session_id(data.value("session_id", ""));
+
+	// READY lists every guild the shard is in, so any other guild loaded from the snapshot has been left since
+	std::unordered_set<uint64_t> ready_guilds;
+	for (const json &guild : array_or_empty(data, "guilds")) {
+		ready_guilds.insert(to_snowflake(guild["id"]));
+	}
+	std::vector<std::string> left_guilds;
+	for (auto &g : guilds) {
+		if (g.second.from_snapshot && ready_guilds.count(g.first) == 0) {
+			left_guilds.push_back(g.second.id);
+		}
+	}
+	for (const std::string &guild_id : left_guilds) {
+		on_event_guild_delete({ { "id", guild_id } });
+	}
+
+	Logger::write("Sign-on confirmed. (@" + user_object.username + "#" + user_object.discriminator_string() + ")", Logger::LogLevel::Info);
+}
 
-	Logger::write("Sign-on confirmed. (@" + user_object.username + "#" + user_object.discriminator + ")", Logger::LogLevel::Info);
+void GatewayHandler::on_event_resumed(const json &data) {
+	Logger::write("Session " + get_session_id() + " resumed at seq " + std::to_string(last_seq), Logger::LogLevel::Info);
 }
 
-void GatewayHandler::on_event_presence_update(json data) {
+void GatewayHandler::on_event_presence_update(const json &data) {
 	std::string user_id = data["user"]["id"];
 
-	auto it = users.find(user_id);
+	auto it = users.find(to_snowflake(user_id));
 	if (it != users.end()) {
-		it->second.status = data.value("status", "offline");
-		if (data["game"] == nullptr) {
+		it->second.set_status(data.value("status", "offline"));
+		auto game = data.find("game");
+		if (game == data.end() || game->is_null()) {
 			it->second.game = "null";
 		}
 		else {
-			it->second.game = data["game"].value("name", "null");
+			it->second.game = game->value("name", "null");
 		}
 	}
-	else {
+	else if (config.cache_members == BotConfig::MemberCaching::All) {
 		Logger::write("Tried to add presence for user " + user_id + " who doesn't exist", Logger::LogLevel::Warning);
 	}
 }
 
-void GatewayHandler::on_event_guild_create(json data) {
-	guilds[data["id"]] = DiscordObjects::Guild(data);
-	DiscordObjects::Guild &guild = guilds[data["id"]];
+void GatewayHandler::on_event_guild_create(const json &data, client &c, websocketpp::connection_hdl &hdl) {
+	DiscordObjects::Guild &guild = guilds[to_snowflake(data["id"])];
+	// sent again for a guild we already have, e.g. after it was unavailable or loaded from a snapshot. Anything deleted
+	// meanwhile isn't in the new lists, so the old members, channels and roles all go before it is rebuilt.
+	int users_removed = remove_guild_members(guild);
+	for (DiscordObjects::Channel *channel : guild.channels) {
+		channels.erase(channel->id);
+	}
+	for (DiscordObjects::Role *role : guild.roles) {
+		roles.erase(role->id);
+	}
+	if (users_removed > 0) {
+		Logger::write(std::to_string(users_removed) + " users no longer visible before reloading guild " + guild.id, Logger::LogLevel::Debug);
+	}
+	guild = DiscordObjects::Guild(data);
 
 	Logger::write("Received info for guild " + guild.id + ", now in " + std::to_string(guilds.size()) + " guild(s)", Logger::LogLevel::Info);
 
 	int channels_added = 0, roles_added = 0, members_added = 0, presences_added = 0;
 
-	for (json channel : data["channels"]) {
+	for (const json &channel : array_or_empty(data, "channels")) {
+		if (!config.cache_voice_channels && channel.value("type", "text") == "voice") continue;
 		std::string channel_id = channel["id"];
-		channel["guild_id"] = guild.id;
 
-		channels[channel_id] = DiscordObjects::Channel(channel);
-		guilds[guild.id].channels.push_back(&channels[channel_id]);
+		DiscordObjects::Channel &new_channel = channels[to_snowflake(channel_id)];
+		new_channel.load_from_json(channel);
+		new_channel.guild_id = guild.id; // not sent inside GUILD_CREATE
+
+		guild.channels.push_back(&new_channel);
 
 		channels_added++;
 	}
-	for (json role : data["roles"]) {
+	for (const json &role : array_or_empty(data, "roles")) {
 		std::string role_id = role["id"];
 
-		roles[role_id] = DiscordObjects::Role(role);
-		guilds[guild.id].roles.push_back(&roles[role_id]);
+		DiscordObjects::Role &new_role = roles[to_snowflake(role_id)];
+		new_role = DiscordObjects::Role(role);
+		guild.roles.push_back(&new_role);
 
 		roles_added++;
 	}
-	for (json member : data["members"]) {
-		std::string user_id = member["user"]["id"];
-
-		auto it = users.find(user_id);
-		if (it == users.end()) { // new user
-			users[user_id] = DiscordObjects::User(member["user"]);
-		}
-		users[user_id].guilds.push_back(guild.id);
-
-		DiscordObjects::GuildMember *guild_member = new DiscordObjects::GuildMember(member, &users[user_id]);
-		for (std::string role_id : member["roles"]) {
-			guild_member->roles.push_back(&roles[role_id]);
-		}
-
-		guilds[guild.id].members.push_back(guild_member);
-
+	// when the cache policies leave these out they were usually dropped while parsing, but not if the dispatch had to be parsed whole
+	bool on_demand_members = config.cache_members == BotConfig::MemberCaching::OnDemand;
+	for (const json &member : on_demand_members ? empty_array : array_or_empty(data, "members")) {
+		add_guild_member(guild, member);
 		members_added++;
 	}
-	for (json presence : data["presences"]) {
+	for (const json &presence : config.cache_presences ? array_or_empty(data, "presences") : empty_array) {
 		std::string user_id = presence["user"]["id"];
 
-		auto it = users.find(user_id);
+		auto it = users.find(to_snowflake(user_id));
 		if (it != users.end()) {
-			it->second.status = presence.value("status", "offline");
-			if (presence["game"] == nullptr) {
+			it->second.set_status(presence.value("status", "offline"));
+			auto game = presence.find("game");
+			if (game == presence.end() || game->is_null()) {
 				it->second.game = "null";
 			} else {
-				it->second.game = presence["game"].value("name", "null");
+				it->second.game = game->value("name", "null");
 			}
 
 			presences_added++;
 		}
-		else {
+		else if (!on_demand_members) {
 			Logger::write("Tried to add presence for user " + user_id + " who doesn't exist", Logger::LogLevel::Warning);
 		}
 	}
 
 	if (v8_instances.count(guild.id) == 0) {
-		v8_instances[guild.id] = std::make_unique<V8Instance>(config, guild.id, &guilds, &channels, &users, &roles);
+		v8_instances[guild.id] = std::make_unique<V8Instance>(config, guild.id);
 		Logger::write("Created v8 instance for guild " + guild.id, Logger::LogLevel::Debug);
 	}
 
 	Logger::write("Loaded " + std::to_string(channels_added) + " channels, " + std::to_string(roles_added)  + " roles and " 
 		+ std::to_string(members_added) + " members (with " + std::to_string(presences_added) + " presences) to guild " + guild.id, Logger::LogLevel::Debug);
+
+	guild.member_count = data.value("member_count", members_added);
+	guild.member_list = data.value("large", false) || on_demand_members ? DiscordObjects::Guild::MemberList::Partial : DiscordObjects::Guild::MemberList::Complete;
+	if (config.member_loading == BotConfig::MemberLoading::Background) {
+		request_member_list(guild, c, hdl);
+	}
 }
 
-void GatewayHandler::on_event_guild_update(json data) {
+void GatewayHandler::on_event_guild_update(const json &data) {
 	std::string guild_id = data["id"];
 
-	guilds[guild_id].load_from_json(data);
+	DiscordObjects::Guild &guild = guilds[to_snowflake(guild_id)];
+	guild.load_from_json(data);
+	update_permissions(guild, guild.id); // the owner may have changed
 	Logger::write("Updated guild " + guild_id, Logger::LogLevel::Debug);
 }
 
-void GatewayHandler::on_event_guild_delete(json data) {
+void GatewayHandler::on_event_guild_delete(const json &data) {
 	std::string guild_id = data["id"];
 	bool unavailable = data.value("unavailable", false);
 
 	if (unavailable) {
 		Logger::write("Guild " + guild_id + " has become unavailable", Logger::LogLevel::Info);
-		guilds[guild_id].unavailable = true;
+		guilds[to_snowflake(guild_id)].unavailable = true;
 	} else {
-		int channels_removed = 0;
-		for (auto it = channels.cbegin(); it != channels.cend();) {
+		auto guild_it = guilds.find(to_snowflake(guild_id));
+		if (guild_it == guilds.end()) {
+			Logger::write("Tried to remove guild " + guild_id + " which doesn't exist", Logger::LogLevel::Warning);
+			return;
+		}
+		DiscordObjects::Guild &guild = guild_it->second;
+
+		int channels_removed = 0, users_removed = 0;
+		for (auto it = channels.begin(); it != channels.end();) {
 			if (it->second.guild_id == guild_id) {
-				channels.erase(it++);
+				it = channels.erase(it);
 				channels_removed++;
 			} else {
 				++it;
 			}
 		}
+		for (DiscordObjects::Role *role : guild.roles) {
+			roles.erase(role->id);
+		}
+		users_removed = remove_guild_members(guild);
+
+		std::string removed = std::to_string(channels_removed) + " channels, " + std::to_string(guild.roles.size()) + " roles and "
+			+ std::to_string(guild.members.size()) + " members (" + std::to_string(users_removed) + " users no longer visible)";
 
-		guilds.erase(guilds.find(guild_id));
-		Logger::write("Guild " + guild_id + " and " + std::to_string(channels_removed) + " channels removed", Logger::LogLevel::Info);
+		// the members are freed with the guild's slab. Views of it are left to their readers.
+		guilds.erase(guild_it);
+		{
+			std::lock_guard<std::mutex> lock(views_mutex);
+			guild_views.erase(to_snowflake(guild_id));
+		}
+		Logger::write("Guild " + guild_id + " removed with " + removed, Logger::LogLevel::Info);
 	}
 }
 
-void GatewayHandler::on_event_guild_member_add(json data) {
+void GatewayHandler::on_event_guild_member_add(const json &data) {
 	std::string guild_id = data["guild_id"];
-	std::string user_id = data["user"]["id"];
+	DiscordObjects::Guild &guild = guilds[to_snowflake(guild_id)];
 
-	auto it = users.find(user_id);
-	if (it == users.end()) { // new user
-		users[user_id] = DiscordObjects::User(data["user"]);
+	bool cached = guild.find_member(to_snowflake(data["user"]["id"])) != nullptr;
+	if (!cached) {
+		guild.member_count++;
 	}
-	users[user_id].guilds.push_back(guild_id);
-
-	DiscordObjects::GuildMember *guild_member = new DiscordObjects::GuildMember(data, &users[user_id]);
-	for (std::string role_id : data["roles"]) {
-		guild_member->roles.push_back(&roles[role_id]);
+	if (!cached && config.cache_members == BotConfig::MemberCaching::OnDemand) {
+		return; // loaded if they use a command
 	}
-
-	guilds[guild_id].members.push_back(guild_member);
+	DiscordObjects::GuildMember *guild_member = add_guild_member(guild, data);
 
 	Logger::write("Added new member " + guild_member->user->id + " to guild " + guild_id, Logger::LogLevel::Debug);
 }
 
-void GatewayHandler::on_event_guild_member_update(json data) {
+void GatewayHandler::on_event_guild_member_update(const json &data) {
 	std::string user_id = data["user"]["id"];
-	DiscordObjects::Guild &guild = guilds[data["guild_id"]];
+	DiscordObjects::Guild &guild = guilds[to_snowflake(data["guild_id"])];
 
-	auto it = std::find_if(guild.members.begin(), guild.members.end(), [user_id](DiscordObjects::GuildMember *member) {
-		return user_id == member->user->id;
-	});
-	if (it != guild.members.end()) {
+	DiscordObjects::GuildMember *member = guild.find_member(to_snowflake(user_id));
+	if (member) {
 		bool nick_changed = false;
 		int roles_change = 0;
 
-		DiscordObjects::GuildMember *member = (*it);
-
 		std::string nick = data.value("nick", "null");
 		if (member->nick != nick) {
 			member->nick = nick;
@@ -318,9 +1442,10 @@ void GatewayHandler::on_event_guild_member_update(json data) {
 		roles_change = member->roles.size();
 		member->roles.clear(); // reset and re-fill, changing the differences is probably more expensive anyway.
 		for (std::string role_id : data["roles"]) {
-			member->roles.push_back(&roles[role_id]);
+			member->roles.push_back(&roles[to_snowflake(role_id)]);
 		}
 		roles_change = member->roles.size() - roles_change;
+		update_permissions(guild, *member);
 		
 		std::string debug_string = "Updated member " + user_id + " of guild " + guild.id;
 		if (nick_changed) debug_string += ". Nick changed to " + nick;
@@ -329,59 +1454,91 @@ void GatewayHandler::on_event_guild_member_update(json data) {
 
 		Logger::write(debug_string, Logger::LogLevel::Debug);
 	}
-	else {
+	else if (config.cache_members == BotConfig::MemberCaching::All) {
 		Logger::write("Tried to update member " + user_id + " (of guild " + guild.id + ") who does not exist.", Logger::LogLevel::Warning);
 	}
 }
 
-void GatewayHandler::on_event_guild_member_remove(json data) {
-	DiscordObjects::Guild &guild = guilds[data["guild_id"]];
+void GatewayHandler::on_event_guild_member_remove(const json &data) {
+	DiscordObjects::Guild &guild = guilds[to_snowflake(data["guild_id"])];
 	std::string user_id = data["user"]["id"];
+	guild.member_count--;
 
-	auto it = std::find_if(guild.members.begin(), guild.members.end(), [user_id](DiscordObjects::GuildMember *member) {
-		return user_id == member->user->id;
-	});
-	if (it != guild.members.end()) {
-		delete (*it);
-		guild.members.erase(it);
-		
-		users[user_id].guilds.erase(std::remove(users[user_id].guilds.begin(), users[user_id].guilds.end(), guild.id));
+	if (guild.remove_member(to_snowflake(user_id))) {
+		auto user_it = users.find(to_snowflake(user_id));
+		std::vector<uint64_t> &user_guilds = user_it->second.guilds;
+		user_guilds.erase(std::remove(user_guilds.begin(), user_guilds.end(), guild.id), user_guilds.end());
 
-		if (users[user_id].guilds.size() == 0) {
-			users.erase(users.find(user_id));
+		if (user_guilds.size() == 0) {
+			users.erase(user_it);
 			Logger::write("User " + user_id + " removed from guild " + guild.id + " and no longer visible, deleted.", Logger::LogLevel::Debug);
 		}
 		else {
 			Logger::write("User " + user_id + " removed from guild " + guild.id, Logger::LogLevel::Debug);
 		}
 	}
-	else {
+	else if (guild.member_list == DiscordObjects::Guild::MemberList::Complete) {
 		Logger::write("Tried to remove guild member " + user_id + " who doesn't exist", Logger::LogLevel::Warning);
 	}
 }
 
-void GatewayHandler::on_event_guild_role_create(json data) {
+void GatewayHandler::on_event_guild_members_chunk(const json &data) {
+	std::string guild_id = data["guild_id"];
+	auto guild_it = guilds.find(to_snowflake(guild_id));
+	if (guild_it == guilds.end()) {
+		Logger::write("Received members for unknown guild " + guild_id, Logger::LogLevel::Warning);
+		return;
+	}
+	DiscordObjects::Guild &guild = guild_it->second;
+
+	const json &members = array_or_empty(data, "members");
+	int members_added = 0;
+	for (const json &member : members) {
+		// online members were already sent in GUILD_CREATE
+		if (!guild.find_member(to_snowflake(member["user"]["id"]))) {
+			add_guild_member(guild, member);
+			members_added++;
+		}
+	}
+
+	// chunks hold up to 1000 members, so a smaller one is the last
+	if (members.size() < 1000 || guild.members.size() >= static_cast<size_t>(guild.member_count)) {
+		guild.member_list = DiscordObjects::Guild::MemberList::Complete;
+		Logger::write("Member list of guild " + guild.id + " loaded (" + std::to_string(guild.members.size()) + " members)", Logger::LogLevel::Debug);
+	}
+	else {
+		Logger::write("Loaded " + std::to_string(members_added) + " members to guild " + guild.id + " ("
+			+ std::to_string(guild.members.size()) + "/" + std::to_string(guild.member_count) + ")", Logger::LogLevel::Debug);
+	}
+}
+
+void GatewayHandler::on_event_guild_role_create(const json &data) {
 	std::string role_id = data["role"]["id"];
 	std::string guild_id = data["guild_id"];
-	roles[role_id] = DiscordObjects::Role(data["role"]);
+	DiscordObjects::Role &role = roles[to_snowflake(role_id)];
+	role = DiscordObjects::Role(data["role"]);
 
-	guilds[guild_id].roles.push_back(&roles[role_id]);
+	DiscordObjects::Guild &guild = guilds[to_snowflake(guild_id)];
+	guild.roles.push_back(&role);
+	// members can be sent with the role before it is created
+	update_permissions(guild, role.id);
 
 	Logger::write("Created role " + role_id + " on guild " + guild_id, Logger::LogLevel::Debug);
 }
 
-void GatewayHandler::on_event_guild_role_update(json data) {
+void GatewayHandler::on_event_guild_role_update(const json &data) {
 	std::string role_id = data["role"]["id"];
 
-	roles[role_id].load_from_json(data["role"]);
+	roles[to_snowflake(role_id)].load_from_json(data["role"]);
+	update_permissions(guilds[to_snowflake(data["guild_id"])], to_snowflake(role_id));
 }
 
-void GatewayHandler::on_event_guild_role_delete(json data) {
+void GatewayHandler::on_event_guild_role_delete(const json &data) {
 	std::string role_id = data["role_id"];
-	auto it = roles.find(role_id);
+	auto it = roles.find(to_snowflake(role_id));
 
 	if (it != roles.end()) {
-		DiscordObjects::Guild &guild = guilds[data["guild_id"]];
+		DiscordObjects::Guild &guild = guilds[to_snowflake(data["guild_id"])];
 
 		auto check_lambda = [role_id](const DiscordObjects::Role *r) {
 			return r->id == role_id;
@@ -395,6 +1552,15 @@ void GatewayHandler::on_event_guild_role_delete(json data) {
 			Logger::write("Tried to delete role " + role_id + " from guild " + guild.id + " but it doesn't exist there", Logger::LogLevel::Warning);
 		}
 
+		// members keep pointers to their roles, so it's taken from them before it is freed
+		for (DiscordObjects::GuildMember *member : guild.members) {
+			auto it3 = std::find_if(member->roles.begin(), member->roles.end(), check_lambda);
+			if (it3 != member->roles.end()) {
+				member->roles.erase(it3);
+				update_permissions(guild, *member);
+			}
+		}
+
 		roles.erase(it);
 		Logger::write("Deleted role " + role_id + " (guild " + guild.id + ").", Logger::LogLevel::Debug);
 	}
@@ -403,59 +1569,88 @@ void GatewayHandler::on_event_guild_role_delete(json data) {
 	}
 }
 
-void GatewayHandler::on_event_channel_create(json data) {
+void GatewayHandler::on_event_channel_create(const json &data) {
+	if (!config.cache_voice_channels && data.value("type", "text") == "voice") {
+		return;
+	}
+
 	std::string channel_id = data["id"];
-	std::string guild_id = data["guild_id"];
+	std::string guild_id = data.at("guild_id");
 
-	channels[channel_id] = DiscordObjects::Channel(data);
+	DiscordObjects::Channel &channel = channels[to_snowflake(channel_id)];
+	channel = DiscordObjects::Channel(data);
 	Logger::write("Added channel " + channel_id + " to channel list. Now " + std::to_string(channels.size()) + " channels stored", Logger::LogLevel::Debug);
-	guilds[guild_id].channels.push_back(&channels[channel_id]);
-	Logger::write("Added channel " + channel_id + " to guild " + guild_id + "'s list. Now " + std::to_string(guilds[guild_id].channels.size()) + " channels stored", Logger::LogLevel::Debug);
+	DiscordObjects::Guild &guild = guilds[to_snowflake(guild_id)];
+	guild.channels.push_back(&channel);
+	Logger::write("Added channel " + channel_id + " to guild " + guild_id + "'s list. Now " + std::to_string(guild.channels.size()) + " channels stored", Logger::LogLevel::Debug);
 }
 
-void GatewayHandler::on_event_channel_update(json data) {
+void GatewayHandler::on_event_channel_update(const json &data) {
 	std::string channel_id = data["id"];
 
-	auto it = channels.find(channel_id);
+	auto it = channels.find(to_snowflake(channel_id));
 	if (it == channels.end()) {
+		if (!config.cache_voice_channels && data.value("type", "text") == "voice") return;
+
 		Logger::write("Got channel update for channel " + channel_id + " that doesn't exist. Creating channel instead.", Logger::LogLevel::Warning);
 		on_event_channel_create(data);
 	} else {
-		channels[channel_id].load_from_json(data);
+		it->second.load_from_json(data);
 		Logger::write("Updated channel " + channel_id, Logger::LogLevel::Debug);
 	}
 }
 
-void GatewayHandler::on_event_channel_delete(json data) {
+void GatewayHandler::on_event_channel_delete(const json &data) {
 	std::string channel_id = data["id"];
-	std::string guild_id = data["guild_id"];
+	std::string guild_id = data.at("guild_id");
 
-	auto it = channels.find(channel_id);
+	auto it = channels.find(to_snowflake(channel_id));
 	if (it == channels.end()) {
 		Logger::write("Tried to delete channel " + channel_id + " which doesn't exist", Logger::LogLevel::Warning);
 	}
 	else {
-		auto it2 = std::find_if(guilds[guild_id].channels.begin(), guilds[guild_id].channels.begin(), [channel_id](const DiscordObjects::Channel *c) {
+		DiscordObjects::Guild &guild = guilds[to_snowflake(guild_id)];
+		auto it2 = std::find_if(guild.channels.begin(), guild.channels.end(), [channel_id](const DiscordObjects::Channel *c) {
 			return c->id == channel_id;
 		});
-		guilds[guild_id].channels.erase(it2);
+		if (it2 != guild.channels.end()) {
+			guild.channels.erase(it2);
+		}
 		Logger::write("Removed channel " + channel_id + " from guild " + guild_id + "'s list. Now " 
-			+ std::to_string(guilds[guild_id].channels.size()) + " channels stored", Logger::LogLevel::Debug);
+			+ std::to_string(guild.channels.size()) + " channels stored", Logger::LogLevel::Debug);
 
 		channels.erase(it);
 		Logger::write("Removed channel " + channel_id + " from channel list. Now " + std::to_string(channels.size()) + " channels stored.", Logger::LogLevel::Debug);
 	}
 }
 
-void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::connection_hdl &hdl) {
+void GatewayHandler::on_event_message_create(const json &data, client &c, websocketpp::connection_hdl &hdl, std::function<void()> &after_unlock, uint64_t &load_members_guild) {
 	std::string message = data["content"];
 
-	DiscordObjects::Channel &channel = channels[data["channel_id"]];
-	DiscordObjects::Guild &guild = guilds[channel.guild_id];
-	DiscordObjects::User &sender = users[data["author"]["id"]];
+	// only holding cache_mutex shared, so nothing can be changed
+	auto channel_it = channels.find(to_snowflake(data["channel_id"]));
+	if (channel_it == channels.end()) return; // DM, or a channel we haven't been told about
+	DiscordObjects::Channel &channel = channel_it->second;
+
+	auto guild_it = guilds.find(channel.guild_id);
+	if (guild_it == guilds.end()) return;
+	DiscordObjects::Guild &guild = guild_it->second;
+
+	// the sender isn't cached yet if the guild's member list is only partly loaded
+	DiscordObjects::User uncached_sender;
+	auto user_it = users.find(to_snowflake(data["author"]["id"]));
+	if (user_it == users.end()) {
+		uncached_sender.load_from_json(data["author"]);
+	}
+	const DiscordObjects::User &sender = user_it == users.end() ? uncached_sender : user_it->second;
 
 	if (sender.bot) return;
 
+	// the request is sent by on_dispatch once it holds cache_mutex exclusively
+	if (guild.member_list == DiscordObjects::Guild::MemberList::Partial) {
+		load_members_guild = guild.id;
+	}
+
 	std::vector<std::string> words;
 	boost::split(words, message, boost::is_any_of(" "));
 	CommandHelper::Command custom_command;
@@ -478,6 +1673,7 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 				return;
 			}
 			else if (words[1] == "stop" || words[1] == "s") {
+				std::lock_guard<std::recursive_mutex> lock(games_mutex);
 				if (games.find(channel.id) != games.end()) {
 					delete_game(channel.id);
 				}
@@ -500,11 +1696,12 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 			}
 		}
 
+		std::lock_guard<std::recursive_mutex> lock(games_mutex);
 		games[channel.id] = std::make_unique<TriviaGame>(config, this, channel.id, questions, delay);
 		games[channel.id]->start();
 	}
 	else if (words[0] == "`guilds") {
-		std::string m = "**Guild List:**\n";
+		std::string m = "**Guild List (shard " + std::to_string(shard_id) + "):**\n";
 		for (auto &gu : guilds) {
 			m += ":small_orange_diamond: " + gu.second.name + " (" + gu.second.id + ") Channels: " + std::to_string(gu.second.channels.size()) + "\n";
 		}
@@ -514,15 +1711,12 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 		DiscordAPI::send_message(channel.id, ":information_source: **toast** by Jack. <http://github.com/jackb-p/Toast>", config.token, config.cert_location);
 	}
 	else if (words[0] == "~js" && words.size() > 1) {
-		DiscordObjects::GuildMember *member = *std::find_if(guild.members.begin(), guild.members.end(), [sender](DiscordObjects::GuildMember *m) {
-			return sender.id == m->user->id;
-		});
-		BotConfig &conf = config;
-		bool disallowed = std::find_if(member->roles.begin(), member->roles.end(), [conf](DiscordObjects::Role *r) -> bool {
-			return conf.js_allowed_roles.count(r->name);
-		}) == member->roles.end(); // checks if the user has the required roles
-
-		if (disallowed) {
+		DiscordObjects::GuildMember *member = guild.find_member(sender.id);
+		if (!member) { // member list of a large guild still loading
+			DiscordAPI::send_message(channel.id, ":warning: Couldn't find you in this server's member list yet, try again shortly.", config.token, config.cert_location);
+			return;
+		}
+		if (!member->js_allowed) { // has none of v8.js_allowed_roles
 			DiscordAPI::send_message(channel.id, ":warning: You do not have permission to use this command.", config.token, config.cert_location);
 			return;
 		}
@@ -530,17 +1724,19 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 		std::string js = message.substr(4);
 		auto it = v8_instances.find(channel.guild_id);
 		if (it != v8_instances.end() && js.length() > 0) {
-			it->second->exec_js(js, &channel, member);
+			V8Instance *instance = it->second.get();
+			after_unlock = [instance, view = get_guild_view(guild), js, channel_id = channel.id, sender_id = sender.id]() {
+				instance->exec_js(view, js, channel_id, sender_id);
+			};
 		}
 	}
 	else if (words[0] == "~createjs" && words.size() > 1) {
-		auto &member = *std::find_if(guild.members.begin(), guild.members.end(), [sender](DiscordObjects::GuildMember *m) { return sender.id == m->user->id; });
-		BotConfig &conf = config;
-		bool disallowed = std::find_if(member->roles.begin(), member->roles.end(), [conf](DiscordObjects::Role *r) -> bool { 
-			return conf.js_allowed_roles.count(r->name);
-		}) == member->roles.end(); // checks if the user has the required roles
-
-		if (disallowed) {
+		DiscordObjects::GuildMember *member = guild.find_member(sender.id);
+		if (!member) { // member list of a large guild still loading
+			DiscordAPI::send_message(channel.id, ":warning: Couldn't find you in this server's member list yet, try again shortly.", config.token, config.cert_location);
+			return;
+		}
+		if (!member->js_allowed) { // has none of v8.js_allowed_roles
 			DiscordAPI::send_message(channel.id, ":warning: You do not have permission to use this command.", config.token, config.cert_location);
 			return;
 		}
@@ -561,17 +1757,58 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 			}
 		}
 	}
-	else if (words[0] == "`shutdown" && sender.id == "82232146579689472") { // it me
+	else if (words[0] == "`shutdown" && sender.id == config.owner_id) {
 		DiscordAPI::send_message(channel.id, ":zzz: Goodbye!", config.token, config.cert_location);
-		for (auto &game : games) {
-			delete_game(game.first);
+		if (shard_manager) {
+			shard_manager->shutdown(); // closes every shard, including this one
+		}
+		else {
+			// shutdown() stops the pipeline, so can't run on one of its workers
+			c.get_io_service().post([this, &c, hdl]() {
+				shutdown();
+				websocketpp::lib::error_code ec;
+				c.close(hdl, websocketpp::close::status::going_away, "", ec);
+			});
 		}
-		v8_instances.clear();
-		c.close(hdl, websocketpp::close::status::going_away, "");
 	}
-	else if (words[0] == "`debug") {
-		if (words[1] == "channel" && words.size() == 3) {
-			auto it = channels.find(words[2]);
+	else if (words[0] == "`debug" && words.size() > 1) {
+		if (words[1] == "events" && words.size() == 2) {
+			DiscordAPI::send_message(channel.id, event_stats_string(), config.token, config.cert_location);
+		}
+		else if (words[1] == "gateway" && words.size() == 2) {
+			DiscordAPI::send_message(channel.id, gateway_stats_string(), config.token, config.cert_location);
+		}
+		else if (words[1] == "allocators" && words.size() == 2) {
+			DiscordAPI::send_message(channel.id, allocator_stats_string(), config.token, config.cert_location);
+		}
+		// these walk every guild and member, so only for the owner
+		else if (words[1] == "memory" && words.size() == 2 && sender.id == config.owner_id) {
+			DiscordAPI::send_message(channel.id, memory_stats_string(), config.token, config.cert_location);
+		}
+		else if (words[1] == "memory" && words.size() == 3 && words[2] == "dump" && sender.id == config.owner_id) {
+			// the report needs the caches, writing it doesn't
+			after_unlock = [this, report = memory_report(), path = memory_report_path(), channel_id = channel.id]() {
+				std::ofstream file(path, std::ios::trunc);
+				file << report.dump(4);
+				if (!file) {
+					DiscordAPI::send_message(channel_id, ":warning: Couldn't write `" + path + "`.", config.token, config.cert_location);
+					return;
+				}
+
+				DiscordAPI::send_message(channel_id, ":floppy_disk: Written to `" + path + "`.", config.token, config.cert_location);
+			};
+		}
+		else if (words[1] == "memory" && words.size() == 3) {
+			auto it = guilds.find(to_snowflake(words[2]));
+			if (it == guilds.end()) {
+				DiscordAPI::send_message(channel.id, ":question: Unrecognised guild.", config.token, config.cert_location);
+				return;
+			}
+
+			DiscordAPI::send_message(channel.id, memory_stats_string(it->second), config.token, config.cert_location);
+		}
+		else if (words[1] == "channel" && words.size() == 3) {
+			auto it = channels.find(to_snowflake(words[2]));
 			if (it == channels.end()) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised channel.", config.token, config.cert_location);
 				return;
@@ -580,7 +1817,7 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 			DiscordAPI::send_message(channel.id, it->second.to_debug_string(), config.token, config.cert_location);
 		}
 		else if (words[1] == "guild" && words.size() == 3) {
-			auto it = guilds.find(words[2]);
+			auto it = guilds.find(to_snowflake(words[2]));
 			if (it == guilds.end()) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised guild.", config.token, config.cert_location);
 				return;
@@ -589,25 +1826,22 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 			DiscordAPI::send_message(channel.id, it->second.to_debug_string(), config.token, config.cert_location);
 		}
 		else if (words[1] == "member" && words.size() == 4) {
-			auto it = guilds.find(words[2]);
+			auto it = guilds.find(to_snowflake(words[2]));
 			if (it == guilds.end()) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised guild.", config.token, config.cert_location);
 				return;
 			}
 
-			std::string user_id = words[3];
-			auto it2 = std::find_if(it->second.members.begin(), it->second.members.end(), [user_id](DiscordObjects::GuildMember *member) {
-				return user_id == member->user->id;
-			});
-			if (it2 == it->second.members.end()) {
+			DiscordObjects::GuildMember *member = it->second.find_member(to_snowflake(words[3]));
+			if (!member) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised user.", config.token, config.cert_location);
 				return;
 			}
 
-			DiscordAPI::send_message(channel.id, (*it2)->to_debug_string(), config.token, config.cert_location);
+			DiscordAPI::send_message(channel.id, member->to_debug_string(), config.token, config.cert_location);
 		}
 		else if (words[1] == "role" && words.size() == 3) {
-			auto it = roles.find(words[2]);
+			auto it = roles.find(to_snowflake(words[2]));
 			if (it == roles.end()) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised role.", config.token, config.cert_location);
 				return;
@@ -618,7 +1852,7 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 		else if (words[1] == "role" && words.size() == 4) {
 			std::string role_name = words[3];
 
-			auto it = guilds.find(words[2]);
+			auto it = guilds.find(to_snowflake(words[2]));
 			if (it == guilds.end()) {
 				DiscordAPI::send_message(channel.id, ":question: Unrecognised guild.", config.token, config.cert_location);
 				return;
@@ -655,17 +1889,43 @@ void GatewayHandler::on_event_message_create(json data, client &c, websocketpp::
 			return;
 		}
 
-		DiscordObjects::GuildMember *member = *std::find_if(guild.members.begin(), guild.members.end(), [sender](DiscordObjects::GuildMember *m) {
-			return sender.id == m->user->id;
-		});
-		it->second->exec_js(custom_command.script, &channel, member, args);
+		DiscordObjects::GuildMember *member = guild.find_member(sender.id);
+		if (!member) { // member list of a large guild still loading
+			DiscordAPI::send_message(channel.id, ":warning: Couldn't find you in this server's member list yet, try again shortly.", config.token, config.cert_location);
+			return;
+		}
+		V8Instance *instance = it->second.get();
+		after_unlock = [instance, view = get_guild_view(guild), script = custom_command.script, channel_id = channel.id, sender_id = sender.id, args]() {
+			instance->exec_js(view, script, channel_id, sender_id, args);
+		};
 	}
-	else if (games.find(channel.id) != games.end()) { // message received in channel with ongoing trivia game
-		games[channel.id]->handle_answer(message, sender);
+	else {
+		std::lock_guard<std::recursive_mutex> lock(games_mutex);
+		auto it = games.find(channel.id);
+		if (it != games.end()) { // message received in channel with ongoing trivia game
+			it->second->handle_answer(message, sender);
+		}
+	}
+}
+
+void GatewayHandler::shutdown() {
+	// finish anything already received first, it may start games
+	pipeline.stop();
+
+	stop_snapshots();
+	if (!config.snapshot_file.empty()) {
+		write_snapshot();
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(games_mutex);
+	while (!games.empty()) {
+		delete_game(games.begin()->first);
 	}
+	v8_instances.clear();
 }
 
 void GatewayHandler::delete_game(std::string channel_id) {
+	std::lock_guard<std::recursive_mutex> lock(games_mutex);
 	auto it = games.find(channel_id);
 
 	if (it != games.end()) {
@@ -2,13 +2,31 @@
 #define BOT_GATEWAYHANDLER
 
 #include <map>
+#include <list>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <functional>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <condition_variable>
 
 #include <websocketpp/client.hpp>
 #include <websocketpp/config/asio_client.hpp>
 #include "json/json.hpp"
 
 #include "TriviaGame.hpp"
+#include "GatewayQueue.hpp"
+#include "EventPipeline.hpp"
+#include "LatencyHistogram.hpp"
+#include "SnowflakeMap.hpp"
+#include "GuildView.hpp"
+#include "MemoryUsage.hpp"
 #include "js/CommandHelper.hpp"
 #include "js/V8Instance.hpp"
 #include "data_structures/User.hpp"
@@ -38,52 +56,250 @@ using json = nlohmann::json;
 
 class TriviaGame;
 class BotConfig;
+class ShardManager;
 
 class GatewayHandler {
 public:
-	GatewayHandler(BotConfig &c);
+	GatewayHandler(BotConfig &c, ShardManager *manager, int shard_id);
+	~GatewayHandler();
 
-	void handle_data(std::string data, client &c, websocketpp::connection_hdl &hdl);
+	// dispatches keep the payload until they are parsed, so it is moved from rather than copied
+	void handle_data(std::string &&data, client &c, websocketpp::connection_hdl &hdl);
 
 	void delete_game(std::string channel_id);
 
+	// Stops all games and destroys the v8 instances, before the connection closes for good. Writes a last snapshot if they are enabled.
+	void shutdown();
+
+	// Called when the connection closes. Returns false if the close code means reconnecting is pointless.
+	bool on_disconnect(int close_code);
+
+	// Discord serialises the event name first ({"t":"NAME",...), so it can be read without parsing the frame
+	static bool peek_event_name(const std::string &data, std::string &event_name);
+
+	// <event name, time from receiving the frame to finishing its handler (us)>, unhandled events are grouped under "(unhandled)"
+	std::map<std::string, LatencyHistogram> get_event_stats();
+
+	// Blocks until every event received so far has been handled
+	void wait_idle() { pipeline.wait_idle(); }
+
 private:
 	BotConfig &config;
+	ShardManager *shard_manager;
+	int shard_id;
 
-	int last_seq;
+	// seq of the last dispatch routed by the pipeline
+	std::atomic<int> last_seq;
 	int heartbeat_interval;
 
+	// kept across connections so the session can be resumed, empty if there is no session
+	std::string session_id;
+	// guards session_id and heartbeat_latency, which are used by the io thread and the pipeline
+	std::mutex session_mutex;
+	std::string get_session_id();
+	void set_session_id(std::string id);
+
+	// every payload sent goes through this
+	GatewayQueue send_queue;
+
 	/* payload dispatchers */
-	void send_heartbeat(client *c, websocketpp::connection_hdl hdl, int interval);
+	void send_heartbeat(client &c, websocketpp::connection_hdl &hdl);
+	// waits for the shard manager's identify slot, then queue_identify
 	void send_identify(client &c, websocketpp::connection_hdl &hdl);
-	void send_request_guild_members(client &c, websocketpp::connection_hdl &hdl, std::string guild_id); // not sure if required atm
+	void queue_identify(client &c, websocketpp::connection_hdl &hdl);
+	void send_resume(client &c, websocketpp::connection_hdl &hdl);
+	void send_request_guild_members(client &c, websocketpp::connection_hdl &hdl, std::string guild_id);
+
+	/* member lists */
+	// requests the rest of the guild's members if only part of the list is loaded, and member loading is enabled.
+	// Needs cache_mutex held exclusively.
+	void request_member_list(DiscordObjects::Guild &guild, client &c, websocketpp::connection_hdl &hdl);
+	// member object as sent in GUILD_CREATE, GUILD_MEMBER_ADD and GUILD_MEMBERS_CHUNK
+	DiscordObjects::GuildMember *add_guild_member(DiscordObjects::Guild &guild, const json &member);
+	// takes the guild out of its members' User::guilds, and drops users left in no guild. Returns how many were dropped.
+	// The members themselves go with the guild.
+	int remove_guild_members(DiscordObjects::Guild &guild);
+
+	/*
+	* Members' permissions and js_allowed bits are worked out whenever their roles, or the roles themselves, change, so
+	* checking a command is a bit test. Needs cache_mutex held exclusively.
+	*/
+	void update_permissions(const DiscordObjects::Guild &guild, DiscordObjects::GuildMember &member);
+	// every member with the role, which is all of them for @everyone (its id is the guild's)
+	void update_permissions(const DiscordObjects::Guild &guild, uint64_t role_id);
+	std::string member_list_stats_string();
+
+	/* on demand members (cache.members) */
+	struct Dispatch; // see the dispatch pipeline
+	// Makes sure the message author's member object is cached before a command that needs it runs. Takes cache_mutex itself.
+	// true if it has to be fetched: the request is made without blocking, and the message is taken and submitted again
+	// to its guild's strand with the response, to be handled then.
+	bool load_member_on_demand(Dispatch &dispatch, client &c, websocketpp::connection_hdl hdl);
+	// fetches still waiting for a response, which the destructor waits for as their callbacks use this
+	int member_fetches;
+	std::mutex member_fetches_mutex;
+	std::condition_variable member_fetches_cv;
+	void touch_user(uint64_t user_id);
+	// drops the least recently used users beyond cache.max_users, with their members. Needs cache_mutex held exclusively.
+	void evict_users();
+	std::string cache_policy_string();
+	// GUILD_CREATE lists not kept by the cache policies, left out when parsing
+	std::vector<std::string> skipped_guild_lists;
+	std::mutex lru_mutex;
+	// most recently used at the front
+	std::list<uint64_t> user_lru;
+	std::unordered_map<uint64_t, std::list<uint64_t>::iterator> user_lru_index;
+	unsigned long users_evicted;
+	// live and free slots in the cache storage
+	std::string allocator_stats_string();
+
+	/* memory accounting (`debug memory`). Walks the caches when asked, so needs cache_mutex held (shared is enough). */
+	// <guild_id, bytes> for running trivia games
+	std::unordered_map<uint64_t, size_t> trivia_memory_usage();
+	MemoryUsage::GuildMemory guild_memory_usage(const DiscordObjects::Guild &guild, const std::unordered_map<uint64_t, size_t> &trivia);
+	// totals, what isn't attributed to a guild, and the largest guilds
+	std::string memory_stats_string();
+	std::string memory_stats_string(const DiscordObjects::Guild &guild);
+	// every guild's breakdown, for tooling. Written to memory_report_path() by `debug memory dump`.
+	json memory_report();
+	std::string memory_report_path();
+
+	/* cache snapshots (cache.snapshot_file) */
+	std::string snapshot_path();
+	// fills the caches from this shard's last snapshot, if there is one. Only called from the constructor.
+	void load_snapshot();
+	// serialises the caches a guild at a time, holding cache_mutex shared for each, then writes the file without it
+	void write_snapshot();
+	// snapshot_thread, writes one every cache.snapshot_interval until stop_snapshots()
+	void run_snapshots();
+	void stop_snapshots();
+	std::string snapshot_stats_string();
+	std::thread snapshot_thread;
+	// guards everything below, and wakes snapshot_thread to stop
+	std::mutex snapshot_mutex;
+	std::condition_variable snapshot_cv;
+	bool snapshot_stopping;
+	unsigned long snapshot_guilds_loaded;
+	unsigned long snapshots_written;
+	std::chrono::system_clock::time_point snapshot_written_at;
+	size_t snapshot_size;
+	// time spent serialising (holding cache_mutex a guild at a time) and writing the last snapshot
+	long snapshot_serialise_ms;
+	long snapshot_write_ms;
 
 	/* payload handlers */
-	void on_hello(json decoded, client &c, websocketpp::connection_hdl &hdl);
-	void on_dispatch(json decoded, client &c, websocketpp::connection_hdl &hdl);
+	void on_hello(const json &decoded, client &c, websocketpp::connection_hdl &hdl);
+	void on_reconnect(client &c, websocketpp::connection_hdl &hdl);
+	void on_invalid_session(const json &decoded, client &c, websocketpp::connection_hdl &hdl);
+	void on_heartbeat_ack();
+
+	/* heartbeating, runs on the client's io_service */
+	void schedule_heartbeat(client &c, websocketpp::connection_hdl hdl);
+	void on_heartbeat_timer(client &c, websocketpp::connection_hdl hdl);
+	std::string gateway_stats_string();
+
+	/* dispatch table */
+	enum class Event {
+		PresenceUpdate, MessageCreate,
+		Ready, Resumed,
+		GuildCreate, GuildUpdate, GuildDelete,
+		GuildMemberAdd, GuildMemberUpdate, GuildMemberRemove, GuildMembersChunk,
+		GuildRoleCreate, GuildRoleUpdate, GuildRoleDelete,
+		ChannelCreate, ChannelUpdate, ChannelDelete,
+		Unhandled // must stay last
+	};
+	static const std::unordered_map<std::string, Event> event_table;
+	static Event get_event(const std::string &event_name);
+	// get_event, except events the cache policies don't need are Unhandled, so their payloads are never parsed
+	Event dispatch_event(const std::string &event_name);
+	std::string event_stats_string();
+
+	/*
+	* Dispatch pipeline. Threading rules:
+	* - Dispatches are parsed on any worker, then run on their guild's strand (DMs and events without a guild share the "" strand).
+	* - Only route_dispatch, called one at a time in seq order, touches channel_guilds (and guild_routed_channels) and writes last_seq.
+	* - The caches (guilds, channels, users, roles, v8_instances and everything they point to) are guarded by cache_mutex.
+	*   MESSAGE_CREATE holds it shared, so must not insert or erase, every other event holds it exclusively.
+	* - games is guarded by games_mutex, since TriviaGame threads delete their own game.
+	* - Control opcodes, heartbeating and the send queue stay on the client's io thread.
+	*/
+	struct Dispatch {
+		std::string raw;
+		json decoded;
+		std::string name;
+		Event event;
+		std::chrono::steady_clock::time_point received;
+		// the sender's member object, once load_member_on_demand has fetched it (null if they couldn't be found)
+		bool member_fetched = false;
+		json member;
+	};
+	void submit_dispatch(std::shared_ptr<Dispatch> dispatch, client &c, websocketpp::connection_hdl hdl);
+	// returns the id of the guild the dispatch belongs to
+	std::string route_dispatch(const Dispatch &dispatch);
+	void on_dispatch(Dispatch &dispatch, client &c, websocketpp::connection_hdl &hdl);
+	void handle_cache_event(Event event, const json &data, client &c, websocketpp::connection_hdl &hdl);
+
+	// <channel_id, guild_id>, for routing messages
+	std::unordered_map<std::string, std::string> channel_guilds;
+	// <guild_id, ids of the guild's channels added to channel_guilds>, so a guild's channels can be dropped without a scan.
+	// Deleted channels are left in until the guild goes.
+	std::unordered_map<std::string, std::vector<std::string>> guild_routed_channels;
+	void unroute_guild(const std::string &guild_id);
+	std::shared_timed_mutex cache_mutex;
+	std::recursive_mutex games_mutex;
+
+	/*
+	* Guild views (see GuildView), for JS commands which run after cache_mutex is released. Every change to a guild (or
+	* to one of its members' users) sets its view_epoch to the next cache_epoch, and a guild's view is only copied
+	* again when it is older than that. Changes to other guilds don't touch it.
+	*/
+	std::atomic<uint64_t> cache_epoch;
+	// need cache_mutex held exclusively
+	void guild_changed(uint64_t guild_id);
+	void user_changed(const DiscordObjects::User &user);
+	// the guilds a cache event changed, from its payload
+	void event_changed_guilds(Event event, const json &data);
+	// caller must hold cache_mutex, shared is enough
+	std::shared_ptr<GuildView> get_guild_view(const DiscordObjects::Guild &guild);
+	std::string guild_view_stats_string();
+	// guards guild_views and the counts, as readers publish views while only holding cache_mutex shared
+	std::mutex views_mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<GuildView>> guild_views;
+	unsigned long views_copied;
+	unsigned long views_reused;
+
+	std::mutex stats_mutex;
+	// indexed by Event, time from receiving the frame to finishing its handler (us)
+	std::array<LatencyHistogram, static_cast<size_t>(Event::Unhandled) + 1> event_latency;
+	// <event name, count> for events without a handler, or ignored by the cache policies
+	std::unordered_map<std::string, unsigned long> unhandled_event_counts;
 
 	/* misc events */
-	void on_event_ready(json data); // https://discordapp.com/developers/docs/topics/gateway#ready
-	void on_event_presence_update(json data); // https://discordapp.com/developers/docs/topics/gateway#presence-update
+	void on_event_ready(const json &data); // https://discordapp.com/developers/docs/topics/gateway#ready
+	void on_event_resumed(const json &data); // https://discordapp.com/developers/docs/topics/gateway#resumed
+	void on_event_presence_update(const json &data); // https://discordapp.com/developers/docs/topics/gateway#presence-update
 
 	/* guild events */
-	void on_event_guild_create(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-create
-	void on_event_guild_update(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-update
-	void on_event_guild_delete(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-delete
-	void on_event_guild_member_add(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-add
-	void on_event_guild_member_update(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-update
-	void on_event_guild_member_remove(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-remove
-	void on_event_guild_role_create(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-create
-	void on_event_guild_role_update(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-update
-	void on_event_guild_role_delete(json data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-delete
+	void on_event_guild_create(const json &data, client &c, websocketpp::connection_hdl &hdl); // https://discordapp.com/developers/docs/topics/gateway#guild-create
+	void on_event_guild_update(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-update
+	void on_event_guild_delete(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-delete
+	void on_event_guild_member_add(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-add
+	void on_event_guild_member_update(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-update
+	void on_event_guild_member_remove(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-member-remove
+	void on_event_guild_members_chunk(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-members-chunk
+	void on_event_guild_role_create(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-create
+	void on_event_guild_role_update(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-update
+	void on_event_guild_role_delete(const json &data); // https://discordapp.com/developers/docs/topics/gateway#guild-role-delete
 
 	/* channel events */
-	void on_event_channel_create(json data); // https://discordapp.com/developers/docs/topics/gateway#channel-create
-	void on_event_channel_update(json data); // https://discordapp.com/developers/docs/topics/gateway#channel-update
-	void on_event_channel_delete(json data); // https://discordapp.com/developers/docs/topics/gateway#channel-delete
+	void on_event_channel_create(const json &data); // https://discordapp.com/developers/docs/topics/gateway#channel-create
+	void on_event_channel_update(const json &data); // https://discordapp.com/developers/docs/topics/gateway#channel-update
+	void on_event_channel_delete(const json &data); // https://discordapp.com/developers/docs/topics/gateway#channel-delete
 
 	/* message events */
-	void on_event_message_create(json data, client &c, websocketpp::connection_hdl &hdl); // https://discordapp.com/developers/docs/topics/gateway#message-create
+	// anything slow that doesn't need the caches (JS) is left in after_unlock, to be run once cache_mutex is released.
+	// load_members_guild is set if the guild's member list should be requested, which needs cache_mutex exclusively.
+	void on_event_message_create(const json &data, client &c, websocketpp::connection_hdl &hdl, std::function<void()> &after_unlock, uint64_t &load_members_guild); // https://discordapp.com/developers/docs/topics/gateway#message-create
 
 	const int protocol_version = 5;
 
@@ -91,17 +307,28 @@ private:
 	DiscordObjects::User user_object;
 
 	/* <id, obj> */
-	std::map<std::string, DiscordObjects::Guild> guilds;
-	std::map<std::string, DiscordObjects::Channel> channels;
-	std::map<std::string, DiscordObjects::User> users;
-	std::map<std::string, DiscordObjects::Role> roles;
+	SnowflakeMap<DiscordObjects::Guild> guilds;
+	SnowflakeMap<DiscordObjects::Channel> channels;
+	SnowflakeMap<DiscordObjects::User> users;
+	SnowflakeMap<DiscordObjects::Role> roles;
 
 	// <channel_id, game obj>
 	std::map<std::string, std::unique_ptr<TriviaGame>> games;
-	// <guild_id, v8 instance>
+	// <guild_id, v8 instance>. Only added to while handling events, so instances can be used after cache_mutex is released
 	std::map<std::string, std::unique_ptr<V8Instance>> v8_instances;
 
-	std::unique_ptr<boost::thread> heartbeat_thread;
+	client::timer_ptr heartbeat_timer;
+	// false between sending a heartbeat and receiving its ACK
+	bool heartbeat_acked;
+	std::chrono::steady_clock::time_point heartbeat_sent;
+	// heartbeat round trip times, ms
+	LatencyHistogram heartbeat_latency;
+	unsigned long zombie_connections;
+	// delayed identify/resume after an invalid session, or identify waiting for its slot
+	client::timer_ptr identify_timer;
+
+	// last so its workers are stopped before anything they use is destroyed
+	EventPipeline pipeline;
 };
 
 #endif
\ No newline at end of file
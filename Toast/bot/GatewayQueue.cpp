@@ -0,0 +1,124 @@
+#include "GatewayQueue.hpp"
+
+#include <algorithm>
+
+#include "Logger.hpp"
+
+const int GatewayQueue::budget_period_ms;
+
+GatewayQueue::GatewayQueue() {
+	window_sent = 0;
+	window_start = std::chrono::steady_clock::now();
+	max_depth = 0;
+	sent = 0;
+	send_failures = 0;
+}
+
+void GatewayQueue::push(client &c, websocketpp::connection_hdl new_hdl, std::string payload, Priority priority, std::function<void()> on_sent) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	hdl = new_hdl;
+	(priority == Priority::High ? high : normal).push_back({ std::move(payload), std::chrono::steady_clock::now(), std::move(on_sent) });
+	max_depth = std::max(max_depth, high.size() + normal.size());
+
+	flush(c);
+}
+
+void GatewayQueue::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!high.empty() || !normal.empty()) {
+		Logger::write("[gateway queue] Dropping " + std::to_string(high.size() + normal.size()) + " unsent payloads", Logger::LogLevel::Debug);
+	}
+	high.clear();
+	normal.clear();
+
+	if (flush_timer) {
+		flush_timer->cancel();
+		flush_timer.reset();
+	}
+
+	window_sent = 0;
+	window_start = std::chrono::steady_clock::now();
+}
+
+size_t GatewayQueue::depth() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return high.size() + normal.size();
+}
+
+std::string GatewayQueue::stats_string() {
+	std::lock_guard<std::mutex> lock(mutex);
+	start_window();
+
+	return "\n**send queue depth:** " + std::to_string(high.size() + normal.size()) + " (max " + std::to_string(max_depth) + ")"
+		+ "\n**send budget left:** " + std::to_string(budget - window_sent) + "/" + std::to_string(budget)
+		+ "\n**sent:** " + std::to_string(sent) + " (" + std::to_string(send_failures) + " failed)"
+		+ "\n**send queue wait:** " + wait_time.to_string("ms");
+}
+
+void GatewayQueue::start_window() {
+	auto now = std::chrono::steady_clock::now();
+	if (now - window_start >= std::chrono::milliseconds(budget_period_ms)) {
+		window_start = now;
+		window_sent = 0;
+	}
+}
+
+bool GatewayQueue::take_send(Priority priority) {
+	int reserve = priority == Priority::High ? 0 : high_priority_reserve;
+	if (window_sent >= budget - reserve) {
+		return false;
+	}
+
+	window_sent++;
+	return true;
+}
+
+void GatewayQueue::flush(client &c) {
+	start_window();
+
+	while (!high.empty() && take_send(Priority::High)) {
+		send(c, high.front());
+		high.pop_front();
+	}
+	while (high.empty() && !normal.empty() && take_send(Priority::Normal)) {
+		send(c, normal.front());
+		normal.pop_front();
+	}
+
+	if ((!high.empty() || !normal.empty()) && !flush_timer) {
+		schedule_flush(c);
+	}
+}
+
+void GatewayQueue::send(client &c, Pending &pending) {
+	wait_time.record(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pending.queued).count());
+
+	websocketpp::lib::error_code ec;
+	c.send(hdl, pending.payload, websocketpp::frame::opcode::text, ec);
+	if (ec) {
+		send_failures++;
+		Logger::write("[gateway queue] Failed to send payload: " + ec.message(), Logger::LogLevel::Warning);
+		return;
+	}
+
+	sent++;
+	if (pending.on_sent) {
+		pending.on_sent();
+	}
+}
+
+void GatewayQueue::schedule_flush(client &c) {
+	// time until the next window, rounded up
+	auto remaining = std::chrono::milliseconds(budget_period_ms) - (std::chrono::steady_clock::now() - window_start);
+	int delay = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count()) + 1;
+
+	flush_timer = c.set_timer(delay, [this, &c](const websocketpp::lib::error_code &ec) {
+		if (ec) return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		flush_timer.reset();
+		flush(c);
+	});
+}
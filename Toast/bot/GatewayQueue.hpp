@@ -0,0 +1,76 @@
+#ifndef BOT_GATEWAYQUEUE
+#define BOT_GATEWAYQUEUE
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <functional>
+
+#include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_client.hpp>
+
+#include "LatencyHistogram.hpp"
+
+typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
+
+/*
+* Outbound payloads for one gateway connection. Discord closes connections which send more than 120 payloads a minute,
+* so sends are counted in fixed 60 second windows of that budget. Payloads over budget wait for the next window on a timer on the client's io_service.
+* High priority payloads (heartbeats, identify, resume) skip ahead of everything else, and a few sends in each window are kept for them only
+* so a burst of normal sends can't delay a heartbeat until the connection is considered dead.
+*/
+class GatewayQueue {
+public:
+	enum class Priority {
+		High, Normal
+	};
+
+	GatewayQueue();
+
+	// Send now if the budget allows, otherwise queue. on_sent is called once the payload has actually been sent. Safe to call from any thread.
+	void push(client &c, websocketpp::connection_hdl hdl, std::string payload, Priority priority, std::function<void()> on_sent = nullptr);
+
+	// Drop anything queued, for when the connection closes. The budget is per connection so a new window is started too.
+	void clear();
+
+	size_t depth();
+	std::string stats_string();
+
+private:
+	static const int budget = 120;
+	static const int budget_period_ms = 60000;
+	static const int high_priority_reserve = 5;
+
+	struct Pending {
+		std::string payload;
+		std::chrono::steady_clock::time_point queued;
+		std::function<void()> on_sent;
+	};
+
+	// must hold mutex
+	void start_window();
+	bool take_send(Priority priority);
+	void flush(client &c);
+	void send(client &c, Pending &pending);
+	void schedule_flush(client &c);
+
+	std::mutex mutex;
+
+	std::deque<Pending> high;
+	std::deque<Pending> normal;
+	websocketpp::connection_hdl hdl;
+	client::timer_ptr flush_timer;
+
+	// payloads sent since window_start
+	int window_sent;
+	std::chrono::steady_clock::time_point window_start;
+
+	// time from push to send, ms
+	LatencyHistogram wait_time;
+	size_t max_depth;
+	unsigned long sent;
+	unsigned long send_failures;
+};
+
+#endif
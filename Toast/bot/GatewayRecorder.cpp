@@ -0,0 +1,75 @@
+#include "GatewayRecorder.hpp"
+
+#include <cstring>
+
+#include "Logger.hpp"
+
+namespace GatewayRecorder {
+	const char magic[8] = { 'T', 'O', 'A', 'S', 'T', 'G', 'W', 'R' };
+
+	Writer::Writer(std::string path) : file(path, std::ios::binary | std::ios::trunc) {
+		frames_written = 0;
+		start = std::chrono::steady_clock::now();
+
+		if (!file) {
+			Logger::write("[recorder] Couldn't open " + path + " for writing, not recording", Logger::LogLevel::Warning);
+			file.close();
+			return;
+		}
+
+		uint64_t start_unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		file.write(magic, sizeof(magic));
+		file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+		file.write(reinterpret_cast<const char *>(&start_unix_ms), sizeof(start_unix_ms));
+
+		Logger::write("[recorder] Recording gateway traffic to " + path, Logger::LogLevel::Info);
+	}
+
+	void Writer::record(const std::string &payload) {
+		if (!file.is_open()) {
+			return;
+		}
+
+		uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		uint32_t length = payload.length();
+
+		file.write(reinterpret_cast<const char *>(&time_us), sizeof(time_us));
+		file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+		file.write(payload.data(), length);
+
+		frames_written++;
+	}
+
+	Reader::Reader(std::string path) : file(path, std::ios::binary) {
+		valid = false;
+		start_unix_ms = 0;
+
+		char file_magic[sizeof(magic)];
+		uint32_t file_version = 0;
+
+		file.read(file_magic, sizeof(file_magic));
+		file.read(reinterpret_cast<char *>(&file_version), sizeof(file_version));
+		file.read(reinterpret_cast<char *>(&start_unix_ms), sizeof(start_unix_ms));
+
+		valid = file && std::memcmp(file_magic, magic, sizeof(magic)) == 0 && file_version == version;
+	}
+
+	bool Reader::next(Frame &frame) {
+		if (!valid) {
+			return false;
+		}
+
+		uint32_t length = 0;
+		file.read(reinterpret_cast<char *>(&frame.time_us), sizeof(frame.time_us));
+		file.read(reinterpret_cast<char *>(&length), sizeof(length));
+		if (!file) {
+			return false;
+		}
+
+		frame.payload.resize(length);
+		file.read(&frame.payload[0], length);
+
+		return static_cast<bool>(file);
+	}
+}
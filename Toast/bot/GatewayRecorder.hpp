@@ -0,0 +1,58 @@
+#ifndef BOT_GATEWAYRECORDER
+#define BOT_GATEWAYRECORDER
+
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+
+/*
+* Gateway traffic log, used to replay real traffic into GatewayHandler without a connection.
+*
+* File layout (host byte order):
+*   header: "TOASTGWR" | uint32 version | uint64 start time (unix ms)
+*   frame:  uint64 time since start (us) | uint32 payload length | payload
+*
+* Payloads are stored after zlib-stream decompression, exactly as passed to GatewayHandler::handle_data.
+*/
+namespace GatewayRecorder {
+	const uint32_t version = 1;
+
+	struct Frame {
+		uint64_t time_us;
+		std::string payload;
+	};
+
+	class Writer {
+	public:
+		// Recording is disabled if the file can't be opened
+		Writer(std::string path);
+
+		bool is_open() const { return file.is_open(); }
+		void record(const std::string &payload);
+
+		unsigned long frames_written;
+
+	private:
+		std::ofstream file;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	class Reader {
+	public:
+		Reader(std::string path);
+
+		// false if the file is missing, or isn't a recording of this version
+		bool is_open() const { return valid; }
+		// Reads the next frame, false at the end of the file
+		bool next(Frame &frame);
+
+		uint64_t start_unix_ms;
+
+	private:
+		std::ifstream file;
+		bool valid;
+	};
+}
+
+#endif
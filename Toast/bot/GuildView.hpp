@@ -0,0 +1,106 @@
+#ifndef BOT_GUILDVIEW
+#define BOT_GUILDVIEW
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+#include "data_structures/Guild.hpp"
+#include "data_structures/Channel.hpp"
+#include "data_structures/Role.hpp"
+#include "data_structures/GuildMember.hpp"
+#include "data_structures/User.hpp"
+
+/*
+* Read-only copy of a guild with its channels, roles and members, for work which runs without cache_mutex (JS commands).
+*
+* A view is copied from the caches at an epoch, and never changed after being published. Writers don't touch views at
+* all, they just move the guild on to a new epoch, and the next reader to want the guild copies a new view. Readers
+* hold views by shared_ptr, so an old view lives until the last reader of it is done, however the caches change
+* meanwhile. Every pointer in a view points into the same view.
+*/
+class GuildView {
+public:
+	// caller must hold cache_mutex (shared is enough)
+	GuildView(const DiscordObjects::Guild &source, uint64_t epoch);
+
+	GuildView(const GuildView &) = delete;
+	GuildView &operator=(const GuildView &) = delete;
+
+	DiscordObjects::Channel *find_channel(uint64_t channel_id);
+	DiscordObjects::GuildMember *find_member(uint64_t user_id) { return guild.find_member(user_id); }
+
+	const uint64_t epoch;
+	DiscordObjects::Guild guild;
+
+private:
+	// deques so the guild's pointers into them stay valid as they are filled
+	std::deque<DiscordObjects::Channel> channels;
+	std::deque<DiscordObjects::Role> roles;
+	std::deque<DiscordObjects::User> users;
+};
+
+inline GuildView::GuildView(const DiscordObjects::Guild &source, uint64_t epoch) : epoch(epoch) {
+	guild.id = source.id;
+	guild.name = source.name;
+	guild.icon = source.icon;
+	guild.splash = source.splash;
+	guild.owner_id = source.owner_id;
+	guild.region = source.region;
+	guild.afk_channel_id = source.afk_channel_id;
+	guild.afk_timeout = source.afk_timeout;
+	guild.verification_level = source.verification_level;
+	guild.unavailable = source.unavailable;
+	guild.member_count = source.member_count;
+	guild.member_list = source.member_list;
+	guild.from_snapshot = source.from_snapshot;
+
+	for (const DiscordObjects::Channel *channel : source.channels) {
+		channels.push_back(*channel);
+		guild.channels.push_back(&channels.back());
+	}
+
+	// members can have roles the guild doesn't list (yet), so these are copied as they are found
+	std::unordered_map<const DiscordObjects::Role *, DiscordObjects::Role *> copied_roles;
+	auto copy_role = [this, &copied_roles](const DiscordObjects::Role *role) {
+		DiscordObjects::Role *&copy = copied_roles[role];
+		if (!copy) {
+			roles.push_back(*role);
+			copy = &roles.back();
+		}
+		return copy;
+	};
+	for (const DiscordObjects::Role *role : source.roles) {
+		guild.roles.push_back(copy_role(role));
+	}
+
+	for (const DiscordObjects::GuildMember *source_member : source.members) {
+		users.push_back(*source_member->user);
+		DiscordObjects::User &user = users.back();
+		std::vector<uint64_t>().swap(user.guilds); // only the live cache needs these
+
+		DiscordObjects::GuildMember *member = guild.add_member(&user);
+		member->nick = source_member->nick;
+		member->joined_at = source_member->joined_at;
+		member->deaf = source_member->deaf;
+		member->mute = source_member->mute;
+		member->permissions = source_member->permissions;
+		member->js_allowed = source_member->js_allowed;
+		member->roles.reserve(source_member->roles.size());
+		for (const DiscordObjects::Role *role : source_member->roles) {
+			member->roles.push_back(copy_role(role));
+		}
+	}
+}
+
+inline DiscordObjects::Channel *GuildView::find_channel(uint64_t channel_id) {
+	for (DiscordObjects::Channel *channel : guild.channels) {
+		if (channel->id == channel_id) {
+			return channel;
+		}
+	}
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "InflateStream.hpp"
+
+#include "Logger.hpp"
+
+static bool has_flush_suffix(const std::string &data) {
+	return data.length() >= 4
+		&& data[data.length() - 4] == '\x00'
+		&& data[data.length() - 3] == '\x00'
+		&& data[data.length() - 2] == '\xff'
+		&& data[data.length() - 1] == '\xff';
+}
+
+InflateStream::InflateStream() {
+	compressed_bytes = inflated_bytes = 0;
+
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	stream.next_in = Z_NULL;
+	stream.avail_in = 0;
+
+	if (inflateInit(&stream) != Z_OK) {
+		Logger::write("[zlib] Failed to initialise inflate stream", Logger::LogLevel::Severe);
+	}
+}
+
+InflateStream::~InflateStream() {
+	inflateEnd(&stream);
+}
+
+void InflateStream::reset() {
+	inflateReset(&stream);
+	pending.clear();
+}
+
+InflateStream::Result InflateStream::feed(const std::string &data, std::string &output) {
+	compressed_bytes += data.length();
+
+	// usually a message holds exactly one payload, so it can be inflated without copying it first
+	const std::string *input = &data;
+	if (!pending.empty() || !has_flush_suffix(data)) {
+		pending += data;
+		if (!has_flush_suffix(pending)) {
+			return Result::Incomplete;
+		}
+		input = &pending;
+	}
+
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input->data()));
+	stream.avail_in = input->length();
+
+	size_t used = 0;
+	if (output.capacity() < input->length() * 4) {
+		output.reserve(input->length() * 4);
+	}
+	output.resize(output.capacity());
+
+	do {
+		if (used == output.length()) {
+			output.resize(output.length() * 2);
+		}
+
+		stream.next_out = reinterpret_cast<Bytef *>(&output[used]);
+		stream.avail_out = output.length() - used;
+
+		int rc = inflate(&stream, Z_SYNC_FLUSH);
+		if (rc != Z_OK && rc != Z_BUF_ERROR) {
+			Logger::write("[zlib] Inflate error " + std::to_string(rc) + (stream.msg ? ": " + std::string(stream.msg) : ""), Logger::LogLevel::Severe);
+			pending.clear();
+			output.clear();
+			return Result::Error;
+		}
+
+		used = output.length() - stream.avail_out;
+	} while (stream.avail_in > 0 || stream.avail_out == 0);
+
+	output.resize(used);
+	pending.clear();
+
+	inflated_bytes += used;
+	return Result::Payload;
+}
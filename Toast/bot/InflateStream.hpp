@@ -0,0 +1,43 @@
+#ifndef BOT_INFLATESTREAM
+#define BOT_INFLATESTREAM
+
+#include <string>
+
+#include <zlib.h>
+
+/*
+* Decompresses a zlib-stream gateway connection. The whole connection shares one zlib context,
+* and a payload is complete once a message ends with the Z_SYNC_FLUSH suffix (00 00 ff ff).
+*/
+class InflateStream {
+public:
+	InflateStream();
+	~InflateStream();
+
+	InflateStream(const InflateStream &) = delete;
+	InflateStream &operator=(const InflateStream &) = delete;
+
+	enum class Result {
+		Incomplete, // the payload continues in a later message
+		Payload, // output holds a complete inflated payload
+		Error // the stream is corrupt, reset() and reconnect
+	};
+
+	// Feed a binary websocket message.
+	// output is overwritten, so passing the same string every time reuses its allocation unless it was moved from.
+	Result feed(const std::string &data, std::string &output);
+
+	// Start again with a fresh context, must be called for every new connection
+	void reset();
+
+	unsigned long long compressed_bytes;
+	unsigned long long inflated_bytes;
+
+private:
+	z_stream stream;
+
+	// compressed data of a payload split over several messages
+	std::string pending;
+};
+
+#endif
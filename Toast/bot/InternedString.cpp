@@ -0,0 +1,130 @@
+#include "InternedString.hpp"
+
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+struct InternedString::Pool {
+	Pool() {
+		// the values most cache fields hold, kept for the life of the process and found without the lock
+		for (const char *value : { "null", "", "online", "offline", "idle", "dnd", "text", "voice", "@everyone" }) {
+			Entry &entry = *values.emplace(std::piecewise_construct, std::forward_as_tuple(value), std::forward_as_tuple()).first;
+			entry.second.permanent = true;
+			common.push_back(&entry);
+		}
+		null_entry = common.front();
+	}
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Count> values; // nodes don't move, so handles can point at them
+	std::vector<Entry *> common;
+	Entry *null_entry;
+};
+
+InternedString::Pool &InternedString::pool() {
+	static Pool p;
+	return p;
+}
+
+InternedString::Entry *InternedString::acquire(const std::string &value) {
+	Pool &p = pool();
+
+	for (Entry *entry : p.common) {
+		if (entry->first == value) {
+			retain(entry);
+			return entry;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(p.mutex);
+	Entry &entry = *p.values.emplace(std::piecewise_construct, std::forward_as_tuple(value), std::forward_as_tuple()).first;
+	retain(&entry);
+	return &entry;
+}
+
+void InternedString::release_last(Entry *entry) {
+	Pool &p = pool();
+	std::lock_guard<std::mutex> lock(p.mutex);
+
+	// may have been handed out again by acquire() or copied since release() looked
+	if (entry->second.refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		p.values.erase(p.values.find(entry->first));
+	}
+}
+
+InternedString::InternedString() : entry(pool().null_entry) {
+	retain(entry);
+}
+
+InternedString::InternedString(const std::string &value) : entry(acquire(value)) {}
+
+InternedString::InternedString(const char *value) : entry(acquire(value)) {}
+
+InternedString::InternedString(const InternedString &other) : entry(other.entry) {
+	retain(entry);
+}
+
+InternedString::~InternedString() {
+	release(entry);
+}
+
+InternedString &InternedString::operator=(const InternedString &other) {
+	if (entry != other.entry) {
+		retain(other.entry);
+		release(entry);
+		entry = other.entry;
+	}
+	return *this;
+}
+
+InternedString &InternedString::operator=(const std::string &value) {
+	if (entry->first != value) {
+		Entry *old = entry;
+		entry = acquire(value);
+		release(old);
+	}
+	return *this;
+}
+
+InternedString &InternedString::operator=(const char *value) {
+	return *this = std::string(value);
+}
+
+// bytes a std::string holding value takes up, including its heap buffer if it is too long to be stored inline
+static size_t string_size(const std::string &value) {
+	const char *data = value.data();
+	const char *object = reinterpret_cast<const char *>(&value);
+	bool inline_buffer = data >= object && data < object + sizeof(std::string);
+	return sizeof(std::string) + (inline_buffer ? 0 : value.capacity() + 1);
+}
+
+std::string InternedString::stats_string() {
+	Pool &p = pool();
+	std::lock_guard<std::mutex> lock(p.mutex);
+
+	size_t references = 0, as_strings = 0, interned = p.values.bucket_count() * sizeof(void *);
+	for (auto &entry : p.values) {
+		long refs = entry.second.refs.load(std::memory_order_relaxed);
+		size_t size = string_size(entry.first);
+
+		references += refs;
+		as_strings += refs * size;
+		// each node is roughly the entry plus a next pointer and cached hash
+		interned += refs * sizeof(InternedString) + sizeof(Entry) - sizeof(std::string) + size + 2 * sizeof(void *);
+	}
+
+	long saved = static_cast<long>(as_strings) - static_cast<long>(interned);
+	return std::to_string(p.values.size()) + " values, " + std::to_string(references) + " references, "
+		+ std::to_string(interned / 1024) + " KB (" + std::to_string(as_strings / 1024) + " KB as strings, saves " + std::to_string(saved / 1024) + " KB)";
+}
+
+size_t InternedString::pool_memory_usage() {
+	Pool &p = pool();
+	std::lock_guard<std::mutex> lock(p.mutex);
+
+	size_t usage = p.values.bucket_count() * sizeof(void *);
+	for (auto &entry : p.values) {
+		usage += sizeof(Entry) - sizeof(std::string) + string_size(entry.first) + 2 * sizeof(void *);
+	}
+	return usage;
+}
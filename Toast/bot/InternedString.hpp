@@ -0,0 +1,98 @@
+#ifndef BOT_INTERNEDSTRING
+#define BOT_INTERNEDSTRING
+
+#include <string>
+#include <atomic>
+#include <utility>
+
+/*
+* Handle to a string kept once in a shared pool, for cache fields which mostly hold a few repeated values (statuses,
+* channel types, role names, "null" etc). A handle is a single pointer, and every handle with the same value points
+* at the same copy, so comparing two handles is a pointer comparison.
+*
+* Pool entries are reference counted and removed with their last handle, except for the common values which are
+* added up front and kept. Handles can be created, copied and destroyed from any thread.
+*/
+class InternedString {
+public:
+	InternedString(); // "null"
+	InternedString(const std::string &value);
+	InternedString(const char *value);
+	InternedString(const InternedString &other);
+	~InternedString();
+
+	InternedString &operator=(const InternedString &other);
+	InternedString &operator=(const std::string &value);
+	InternedString &operator=(const char *value);
+
+	const std::string &str() const { return entry->first; }
+	operator const std::string &() const { return entry->first; }
+	const char *c_str() const { return entry->first.c_str(); }
+	size_t length() const { return entry->first.length(); }
+	bool empty() const { return entry->first.empty(); }
+
+	/*
+	* Comparisons with each other are by pointer, everything else by value. These are friends so they are only found
+	* when one side is an InternedString, otherwise json's conversion operators make unrelated comparisons ambiguous.
+	*/
+	friend bool operator==(const InternedString &lhs, const InternedString &rhs) { return &lhs.str() == &rhs.str(); }
+	friend bool operator!=(const InternedString &lhs, const InternedString &rhs) { return !(lhs == rhs); }
+	friend bool operator==(const InternedString &lhs, const std::string &rhs) { return lhs.str() == rhs; }
+	friend bool operator==(const std::string &lhs, const InternedString &rhs) { return lhs == rhs.str(); }
+	friend bool operator!=(const InternedString &lhs, const std::string &rhs) { return lhs.str() != rhs; }
+	friend bool operator!=(const std::string &lhs, const InternedString &rhs) { return lhs != rhs.str(); }
+	friend bool operator==(const InternedString &lhs, const char *rhs) { return lhs.str() == rhs; }
+	friend bool operator==(const char *lhs, const InternedString &rhs) { return lhs == rhs.str(); }
+	friend bool operator!=(const InternedString &lhs, const char *rhs) { return lhs.str() != rhs; }
+	friend bool operator!=(const char *lhs, const InternedString &rhs) { return lhs != rhs.str(); }
+
+	friend std::string operator+(const std::string &lhs, const InternedString &rhs) { return lhs + rhs.str(); }
+	friend std::string operator+(std::string &&lhs, const InternedString &rhs) { return std::move(lhs) + rhs.str(); }
+	friend std::string operator+(const char *lhs, const InternedString &rhs) { return lhs + rhs.str(); }
+	friend std::string operator+(const InternedString &lhs, const std::string &rhs) { return lhs.str() + rhs; }
+	friend std::string operator+(const InternedString &lhs, const char *rhs) { return lhs.str() + rhs; }
+
+	// number of distinct values, references to them, and memory compared to a std::string per reference
+	static std::string stats_string();
+	// bytes the pool itself takes up, not counting the handles
+	static size_t pool_memory_usage();
+
+private:
+	struct Count {
+		Count() : refs(0), permanent(false) {}
+
+		std::atomic<long> refs;
+		bool permanent;
+	};
+	typedef std::pair<const std::string, Count> Entry;
+
+	struct Pool;
+	static Pool &pool();
+
+	Entry *entry;
+
+	static Entry *acquire(const std::string &value);
+	static void release_last(Entry *entry);
+
+	static void retain(Entry *entry) {
+		entry->second.refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void release(Entry *entry) {
+		if (entry->second.permanent) {
+			entry->second.refs.fetch_sub(1, std::memory_order_relaxed);
+			return;
+		}
+
+		// only the last reference needs the pool lock. Decrements release, so reads through this handle happen before the entry can be freed.
+		long refs = entry->second.refs.load(std::memory_order_relaxed);
+		while (refs > 1) {
+			if (entry->second.refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed)) {
+				return;
+			}
+		}
+		release_last(entry);
+	}
+};
+
+#endif
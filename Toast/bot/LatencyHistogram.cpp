@@ -0,0 +1,73 @@
+#include "LatencyHistogram.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram() {
+	clear();
+}
+
+void LatencyHistogram::clear() {
+	buckets.fill(0);
+	total_count = 0;
+	total = 0;
+	min_value = max_value = 0;
+}
+
+void LatencyHistogram::record(long value) {
+	if (value < 0) {
+		value = 0;
+	}
+
+	int bucket = 0;
+	while (bucket < bucket_count - 1 && value >= (1L << bucket)) {
+		bucket++;
+	}
+	buckets[bucket]++;
+
+	if (total_count == 0 || value < min_value) min_value = value;
+	if (total_count == 0 || value > max_value) max_value = value;
+
+	total_count++;
+	total += value;
+}
+
+double LatencyHistogram::mean() const {
+	return total_count == 0 ? 0 : static_cast<double>(total / total_count);
+}
+
+long LatencyHistogram::percentile(double p) const {
+	if (total_count == 0) {
+		return 0;
+	}
+
+	unsigned long target = static_cast<unsigned long>(p / 100.0 * total_count + 0.5);
+	if (target == 0) target = 1;
+
+	unsigned long seen = 0;
+	for (int i = 0; i < bucket_count; i++) {
+		seen += buckets[i];
+		if (seen >= target) {
+			// a bucket's upper bound can't be more than the largest value actually seen
+			return i == bucket_count - 1 ? max_value : std::min(1L << i, max_value);
+		}
+	}
+
+	return max_value;
+}
+
+std::string LatencyHistogram::to_string(std::string unit) const {
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1)
+		<< "n=" << total_count
+		<< " min=" << min_value
+		<< " avg=" << mean()
+		<< " p50=" << percentile(50)
+		<< " p90=" << percentile(90)
+		<< " p99=" << percentile(99)
+		<< " max=" << max_value
+		<< " " << unit;
+
+	return ss.str();
+}
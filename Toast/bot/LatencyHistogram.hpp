@@ -0,0 +1,38 @@
+#ifndef BOT_LATENCYHISTOGRAM
+#define BOT_LATENCYHISTOGRAM
+
+#include <array>
+#include <string>
+
+/*
+* Power-of-two bucketed histogram. Bucket 0 counts values below 1, bucket i counts values in [2^(i-1), 2^i)
+* and the last bucket everything above. Units are up to the caller.
+*/
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void record(long value);
+	void clear();
+
+	unsigned long count() const { return total_count; }
+	long min() const { return min_value; }
+	long max() const { return max_value; }
+	double mean() const;
+	// upper bound of the bucket holding the given percentile (0-100)
+	long percentile(double p) const;
+
+	// one line summary, e.g. "n=120 min=31 avg=40.2 p50=64 p90=64 p99=97 max=97 ms"
+	std::string to_string(std::string unit) const;
+
+private:
+	static const int bucket_count = 32;
+	std::array<unsigned long, bucket_count> buckets;
+
+	unsigned long total_count;
+	long double total;
+	long min_value;
+	long max_value;
+};
+
+#endif
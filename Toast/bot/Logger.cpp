@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <ctime>
+#include <mutex>
 
 namespace Logger {
 	std::ostream &operator<<(std::ostream &out, const LogLevel log_level) {
@@ -31,17 +32,21 @@ namespace Logger {
 		return std::cerr;
 	}
 
+	// shards log from their own threads
+	std::mutex write_mutex;
+
 	void write(std::string text, LogLevel log_level) {
 		time_t rawtime;
-		struct tm *timeinfo;
+		struct tm timeinfo;
 		char buffer[80];
 
 		time(&rawtime);
-		timeinfo = localtime(&rawtime);
+		localtime_r(&rawtime, &timeinfo);
 
-		strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", timeinfo);
+		strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", &timeinfo);
 		std::string time_str(buffer);
 
+		std::lock_guard<std::mutex> lock(write_mutex);
 		get_ostream(log_level) << "[" << time_str << "] [" << log_level << "] " << text << std::endl;
 	}
 }
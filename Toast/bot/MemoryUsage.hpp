@@ -0,0 +1,131 @@
+#ifndef BOT_MEMORYUSAGE
+#define BOT_MEMORYUSAGE
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+#include "json/json.hpp"
+
+#include "data_structures/Guild.hpp"
+#include "data_structures/Channel.hpp"
+#include "data_structures/Role.hpp"
+#include "data_structures/GuildMember.hpp"
+#include "data_structures/User.hpp"
+
+using json = nlohmann::json;
+
+/*
+* Estimates of the memory the caches use, for `debug memory`. Objects count as their slot in the cache plus whatever
+* their members allocate. Interned strings count as the handle only, the pool is reported on its own.
+*/
+namespace MemoryUsage {
+	// bytes on the heap, 0 if the string is short enough to be stored inline
+	inline size_t heap_bytes(const std::string &value) {
+		const char *data = value.data();
+		const char *object = reinterpret_cast<const char *>(&value);
+		bool inline_buffer = data >= object && data < object + sizeof(std::string);
+		return inline_buffer ? 0 : value.capacity() + 1;
+	}
+
+	template <typename T>
+	inline size_t heap_bytes(const std::vector<T> &values) {
+		return values.capacity() * sizeof(T);
+	}
+
+	// roughly, each node is the pair plus a next pointer and cached hash
+	template <typename K, typename V>
+	inline size_t heap_bytes(const std::unordered_map<K, V> &values) {
+		return values.bucket_count() * sizeof(void *) + values.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void *));
+	}
+
+	inline size_t bytes(const DiscordObjects::User &user) {
+		return sizeof(std::pair<const uint64_t, DiscordObjects::User>) + heap_bytes(user.username) + heap_bytes(user.guilds);
+	}
+
+	inline size_t bytes(const DiscordObjects::Channel &channel) {
+		return sizeof(std::pair<const uint64_t, DiscordObjects::Channel>) + heap_bytes(channel.name) + heap_bytes(channel.topic);
+	}
+
+	inline size_t bytes(const DiscordObjects::Role &) {
+		return sizeof(std::pair<const uint64_t, DiscordObjects::Role>);
+	}
+
+	struct GuildMemory {
+		size_t guild = 0;		// the guild itself, its lists and member index
+		size_t channels = 0;
+		size_t roles = 0;
+		size_t members = 0;		// the member slab, free slots included, and the members' role lists
+		size_t users = 0;		// each user is split evenly between the guilds they are in
+		size_t v8_heap = 0;		// heap the guild's isolate has reserved, as of its last script
+		size_t v8_heap_used = 0;	// part of v8_heap in use, not added to the total
+		size_t trivia = 0;		// games running in the guild's channels
+
+		size_t total() const {
+			return guild + channels + roles + members + users + v8_heap + trivia;
+		}
+
+		GuildMemory &operator+=(const GuildMemory &other) {
+			guild += other.guild;
+			channels += other.channels;
+			roles += other.roles;
+			members += other.members;
+			users += other.users;
+			v8_heap += other.v8_heap;
+			v8_heap_used += other.v8_heap_used;
+			trivia += other.trivia;
+			return *this;
+		}
+
+		std::string to_string() const {
+			return std::to_string(total() / 1024) + " KB (guild " + std::to_string(guild / 1024)
+				+ ", channels " + std::to_string(channels / 1024)
+				+ ", roles " + std::to_string(roles / 1024)
+				+ ", members " + std::to_string(members / 1024)
+				+ ", users " + std::to_string(users / 1024)
+				+ ", v8 " + std::to_string(v8_heap / 1024) + " (" + std::to_string(v8_heap_used / 1024) + " used)"
+				+ ", trivia " + std::to_string(trivia / 1024) + ")";
+		}
+
+		json to_json() const {
+			return {
+				{ "total", total() },
+				{ "guild", guild },
+				{ "channels", channels },
+				{ "roles", roles },
+				{ "members", members },
+				{ "users", users },
+				{ "v8_heap", v8_heap },
+				{ "v8_heap_used", v8_heap_used },
+				{ "trivia", trivia }
+			};
+		}
+	};
+
+	// everything but v8_heap and trivia, which the cache doesn't own. Needs cache_mutex held (shared is enough).
+	inline GuildMemory guild_memory(const DiscordObjects::Guild &guild) {
+		GuildMemory memory;
+
+		memory.guild = sizeof(std::pair<const uint64_t, DiscordObjects::Guild>) + heap_bytes(guild.name) + heap_bytes(guild.icon) + heap_bytes(guild.splash)
+			+ heap_bytes(guild.region) + heap_bytes(guild.channels) + heap_bytes(guild.roles) + heap_bytes(guild.members) + heap_bytes(guild.member_index);
+
+		for (const DiscordObjects::Channel *channel : guild.channels) {
+			memory.channels += bytes(*channel);
+		}
+		for (const DiscordObjects::Role *role : guild.roles) {
+			memory.roles += bytes(*role);
+		}
+
+		memory.members = guild.member_slab.memory_usage();
+		for (const DiscordObjects::GuildMember *member : guild.members) {
+			memory.members += heap_bytes(member->roles);
+			memory.users += bytes(*member->user) / (member->user->guilds.empty() ? 1 : member->user->guilds.size());
+		}
+
+		return memory;
+	}
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "ShardManager.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+#include "ClientConnection.hpp"
+#include "BotConfig.hpp"
+#include "Logger.hpp"
+
+// Discord allows one identify every 5 seconds
+const std::chrono::seconds identify_spacing(5);
+
+ShardManager::ShardManager(BotConfig &c, std::string url) : config(c), url(url) {
+	stopping = false;
+	exit_code = 0;
+}
+
+int ShardManager::run() {
+	Logger::write("Starting shards " + std::to_string(config.shard_first) + " to " + std::to_string(config.shard_last)
+		+ " (of " + std::to_string(config.shard_count) + ")", Logger::LogLevel::Info);
+
+	std::vector<std::unique_ptr<boost::thread>> threads;
+	for (int shard_id = config.shard_first; shard_id <= config.shard_last; shard_id++) {
+		threads.push_back(std::make_unique<boost::thread>(boost::bind(&ShardManager::run_shard, this, shard_id)));
+	}
+
+	for (auto &thread : threads) {
+		thread->join();
+	}
+
+	return exit_code;
+}
+
+void ShardManager::shutdown() {
+	stopping = true;
+
+	std::lock_guard<std::mutex> lock(connections_mutex);
+	for (auto &conn : connections) {
+		conn.second->stop();
+	}
+}
+
+std::chrono::milliseconds ShardManager::reserve_identify() {
+	std::lock_guard<std::mutex> lock(identify_mutex);
+	auto now = std::chrono::steady_clock::now();
+
+	auto slot = std::max(now, next_identify);
+	next_identify = slot + identify_spacing;
+	// rounded up, so a timer for it doesn't fire early
+	return std::chrono::duration_cast<std::chrono::milliseconds>(slot - now + std::chrono::microseconds(999));
+}
+
+bool ShardManager::set_connection(int shard_id, ClientConnection *conn) {
+	std::lock_guard<std::mutex> lock(connections_mutex);
+
+	if (conn) {
+		// checked under the lock, so shutdown() either sees this connection or has already set stopping
+		if (stopping) {
+			return false;
+		}
+		connections[shard_id] = conn;
+	}
+	else {
+		connections.erase(shard_id);
+	}
+	return true;
+}
+
+void ShardManager::run_shard(int shard_id) {
+	std::string shard_str = "[shard " + std::to_string(shard_id) + "] ";
+
+	bool retry = true;
+	while (retry && !stopping) {
+		retry = false;
+
+		std::unique_ptr<ClientConnection> conn;
+		try {
+			conn = std::make_unique<ClientConnection>(config, this, shard_id);
+			if (set_connection(shard_id, conn.get())) {
+				conn->start(url);
+			}
+		}
+		catch (const std::exception &e) {
+			Logger::write(shard_str + "std exception: " + std::string(e.what()), Logger::LogLevel::Severe);
+			exit_code = 1;
+			shutdown();
+		}
+		catch (websocketpp::lib::error_code e) {
+			Logger::write(shard_str + "websocketpp exception: " + e.message(), Logger::LogLevel::Severe);
+			retry = true; // should just be an occasional connection issue
+		}
+		catch (...) {
+			Logger::write(shard_str + "other exception.", Logger::LogLevel::Severe);
+			exit_code = 2;
+			shutdown();
+		}
+		set_connection(shard_id, nullptr);
+
+		if (retry) {
+			conn.reset();
+			boost::this_thread::sleep_for(boost::chrono::seconds(10));
+		}
+	}
+
+	Logger::write(shard_str + "Finished", Logger::LogLevel::Debug);
+}
@@ -0,0 +1,51 @@
+#ifndef BOT_SHARDMANAGER
+#define BOT_SHARDMANAGER
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <chrono>
+
+class BotConfig;
+class ClientConnection;
+
+/*
+* Runs one gateway connection per shard, each on its own thread with its own io_service and GatewayHandler.
+* Discord only sends a guild's events to shard (guild_id >> 22) % shard_count, so each GatewayHandler's
+* cache holds exactly the guilds of its shard.
+*/
+class ShardManager {
+public:
+	ShardManager(BotConfig &c, std::string url);
+
+	// Starts every shard in the configured range and blocks until they have all finished. Returns the exit code.
+	int run();
+
+	// Closes every shard's connection, and stops them from reconnecting. Safe to call from any thread.
+	void shutdown();
+
+	// Reserves the next identify slot across all shards and returns how long to wait for it. Every identify,
+	// including those after an invalid session or a closed session, must go through this. Safe to call from any thread.
+	std::chrono::milliseconds reserve_identify();
+
+private:
+	BotConfig &config;
+	std::string url;
+
+	void run_shard(int shard_id);
+	// false, without registering it, once shutdown() has started, as it would never be stopped
+	bool set_connection(int shard_id, ClientConnection *conn);
+
+	std::atomic<bool> stopping;
+	std::atomic<int> exit_code;
+
+	// <shard_id, connection> of the connections which are currently running
+	std::map<int, ClientConnection *> connections;
+	std::mutex connections_mutex;
+
+	std::chrono::steady_clock::time_point next_identify;
+	std::mutex identify_mutex;
+};
+
+#endif
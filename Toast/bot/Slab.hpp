@@ -0,0 +1,136 @@
+#ifndef BOT_SLAB
+#define BOT_SLAB
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <utility>
+#include <type_traits>
+
+/*
+* Pool of T objects, allocated from chunks instead of one heap allocation each.
+*
+* New objects reuse the most recently destroyed slot if there is one, otherwise they take the next slot in the newest
+* chunk (a pointer bump). Chunks start small and double in size, so a guild with a handful of members doesn't reserve
+* space for thousands. Objects never move, and clear() (or destroying the slab) destroys every live object and frees
+* all the chunks at once.
+*/
+template <typename T>
+class Slab {
+public:
+	Slab() : next_free(nullptr), bump(0), live_count(0), slot_count(0) {}
+	~Slab() { clear(); }
+
+	Slab(const Slab &) = delete;
+	Slab &operator=(const Slab &) = delete;
+
+	// the chunks don't move, so pointers into the old slab stay valid
+	Slab(Slab &&other) : Slab() { swap(other); }
+	Slab &operator=(Slab &&other) {
+		if (this != &other) {
+			clear();
+			swap(other);
+		}
+		return *this;
+	}
+
+	template <typename... Args>
+	T *create(Args&&... args) {
+		Slot *slot = next_free;
+		if (slot) {
+			next_free = slot->next_free;
+		}
+		else {
+			if (chunks.empty() || bump == chunks.back().size) {
+				size_t size = first_chunk_size;
+				if (!chunks.empty()) {
+					size = chunks.back().size * 2 > max_chunk_size ? max_chunk_size : chunks.back().size * 2;
+				}
+				chunks.push_back({ std::unique_ptr<Slot[]>(new Slot[size]), size });
+				slot_count += size;
+				bump = 0;
+			}
+			slot = &chunks.back().slots[bump++];
+		}
+
+		T *object = new (&slot->storage) T(std::forward<Args>(args)...);
+		slot->used = true;
+		live_count++;
+		return object;
+	}
+
+	// object must have come from create() on this slab
+	void destroy(T *object) {
+		if (!object) return;
+
+		Slot *slot = reinterpret_cast<Slot *>(object);
+		object->~T();
+		slot->used = false;
+		slot->next_free = next_free;
+		next_free = slot;
+		live_count--;
+	}
+
+	void clear() {
+		for (size_t i = 0; i < chunks.size(); i++) {
+			// only the newest chunk can have slots which were never handed out
+			size_t used_size = i == chunks.size() - 1 ? bump : chunks[i].size;
+			for (size_t j = 0; j < used_size; j++) {
+				Slot &slot = chunks[i].slots[j];
+				if (slot.used) {
+					reinterpret_cast<T *>(&slot.storage)->~T();
+				}
+			}
+		}
+		chunks.clear();
+		next_free = nullptr;
+		bump = live_count = slot_count = 0;
+	}
+
+	size_t live() const { return live_count; }
+	size_t free() const { return slot_count - live_count; }
+	size_t chunk_count() const { return chunks.size(); }
+
+	// Bytes used by the slab itself, not counting anything the objects allocate
+	size_t memory_usage() const {
+		return slot_count * sizeof(Slot) + chunks.capacity() * sizeof(Chunk);
+	}
+
+	std::string stats_string() const {
+		return std::to_string(live_count) + " live, " + std::to_string(free()) + " free in " + std::to_string(chunks.size()) + " chunk(s)";
+	}
+
+private:
+	static const size_t first_chunk_size = 16;
+	static const size_t max_chunk_size = 1024;
+
+	// storage comes first, so a T * is also a Slot *
+	struct Slot {
+		union {
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+			Slot *next_free;
+		};
+		bool used = false;
+	};
+
+	struct Chunk {
+		std::unique_ptr<Slot[]> slots;
+		size_t size;
+	};
+
+	std::vector<Chunk> chunks;
+	Slot *next_free;
+	size_t bump; // slots handed out from the newest chunk
+	size_t live_count;
+	size_t slot_count;
+
+	void swap(Slab &other) {
+		std::swap(chunks, other.chunks);
+		std::swap(next_free, other.next_free);
+		std::swap(bump, other.bump);
+		std::swap(live_count, other.live_count);
+		std::swap(slot_count, other.slot_count);
+	}
+};
+
+#endif
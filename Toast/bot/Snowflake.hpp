@@ -0,0 +1,67 @@
+#ifndef BOT_SNOWFLAKE
+#define BOT_SNOWFLAKE
+
+#include <string>
+#include <cstdint>
+#include <utility>
+
+/* Parses a decimal snowflake. Anything which isn't one (e.g. "null") gives 0, which Discord never uses as an id. */
+inline uint64_t to_snowflake(const std::string &id) {
+	if (id.empty() || id.length() > 20) {
+		return 0;
+	}
+
+	uint64_t value = 0;
+	for (char c : id) {
+		if (c < '0' || c > '9') {
+			return 0;
+		}
+		value = value * 10 + (c - '0');
+	}
+	return value;
+}
+
+/*
+* An id stored as its 64 bit value rather than the decimal string Discord sends.
+*
+* Converts to uint64_t (for the caches' keys) and to std::string, and compares and concatenates with strings, so it
+* can be used where the string ids were. 0 stands in for the old "null" sentinel and prints as "null".
+*/
+class Snowflake {
+public:
+	Snowflake() : value(0) {}
+	explicit Snowflake(uint64_t value) : value(value) {}
+	explicit Snowflake(const std::string &id) : value(to_snowflake(id)) {}
+
+	Snowflake &operator=(const std::string &id) {
+		value = to_snowflake(id);
+		return *this;
+	}
+
+	operator uint64_t() const { return value; }
+	operator std::string() const { return str(); }
+	std::string str() const { return value == 0 ? "null" : std::to_string(value); }
+
+	/* friends so they are only found when one side is a Snowflake, like InternedString's */
+	friend bool operator==(const Snowflake &lhs, const Snowflake &rhs) { return lhs.value == rhs.value; }
+	friend bool operator!=(const Snowflake &lhs, const Snowflake &rhs) { return lhs.value != rhs.value; }
+	friend bool operator==(const Snowflake &lhs, const std::string &rhs) { return lhs.value == to_snowflake(rhs); }
+	friend bool operator==(const std::string &lhs, const Snowflake &rhs) { return to_snowflake(lhs) == rhs.value; }
+	friend bool operator!=(const Snowflake &lhs, const std::string &rhs) { return !(lhs == rhs); }
+	friend bool operator!=(const std::string &lhs, const Snowflake &rhs) { return !(lhs == rhs); }
+	friend bool operator==(const Snowflake &lhs, const char *rhs) { return lhs.value == to_snowflake(rhs); }
+	friend bool operator==(const char *lhs, const Snowflake &rhs) { return to_snowflake(lhs) == rhs.value; }
+	friend bool operator!=(const Snowflake &lhs, const char *rhs) { return !(lhs == rhs); }
+	friend bool operator!=(const char *lhs, const Snowflake &rhs) { return !(lhs == rhs); }
+
+	friend std::string operator+(const std::string &lhs, const Snowflake &rhs) { return lhs + rhs.str(); }
+	friend std::string operator+(std::string &&lhs, const Snowflake &rhs) { return std::move(lhs) + rhs.str(); }
+	friend std::string operator+(const char *lhs, const Snowflake &rhs) { return lhs + rhs.str(); }
+	friend std::string operator+(const Snowflake &lhs, const std::string &rhs) { return lhs.str() + rhs; }
+	friend std::string operator+(const Snowflake &lhs, const char *rhs) { return lhs.str() + rhs; }
+
+private:
+	uint64_t value;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef BOT_SNOWFLAKEMAP
+#define BOT_SNOWFLAKEMAP
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+
+#include "Snowflake.hpp"
+
+/*
+* Hash map from snowflakes to T, replacing std::map<std::string, T> for the caches.
+*
+* Elements live in fixed size chunks which are never moved, so pointers and references to them stay valid until
+* the element is erased (the caches hold raw pointers to each other). The index is a separate open addressing table
+* of (key, slot) pairs with linear probing and backward shift deletion, so it has no tombstones, and growing it only
+* rehashes the index. Erased slots are reused by later inserts.
+*
+* The interface is the subset of std::map used by the caches. Iteration order is unspecified.
+*/
+template <typename T>
+class SnowflakeMap {
+public:
+	typedef uint64_t key_type;
+	typedef T mapped_type;
+	typedef std::pair<const uint64_t, T> value_type;
+
+private:
+	static const uint32_t chunk_size = 256;
+	static const uint32_t empty_slot = UINT32_MAX;
+
+	struct Slot {
+		typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type storage;
+		bool used;
+
+		value_type &value() { return *reinterpret_cast<value_type *>(&storage); }
+		const value_type &value() const { return *reinterpret_cast<const value_type *>(&storage); }
+	};
+
+	struct Bucket {
+		uint64_t key;
+		uint32_t slot;
+	};
+
+	template <bool Const>
+	class basic_iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef typename SnowflakeMap::value_type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef typename std::conditional<Const, const value_type *, value_type *>::type pointer;
+		typedef typename std::conditional<Const, const value_type &, value_type &>::type reference;
+
+		basic_iterator() : map(nullptr), slot(0) {}
+		// iterator converts to const_iterator
+		basic_iterator(const basic_iterator<false> &other) : map(other.map), slot(other.slot) {}
+
+		reference operator*() const { return map->slot_at(slot).value(); }
+		pointer operator->() const { return &map->slot_at(slot).value(); }
+
+		basic_iterator &operator++() {
+			slot = map->next_used(slot + 1);
+			return *this;
+		}
+		basic_iterator operator++(int) {
+			basic_iterator old = *this;
+			++(*this);
+			return old;
+		}
+
+		bool operator==(const basic_iterator &rhs) const { return slot == rhs.slot; }
+		bool operator!=(const basic_iterator &rhs) const { return slot != rhs.slot; }
+
+	private:
+		friend class SnowflakeMap;
+		template <bool> friend class basic_iterator;
+
+		typedef typename std::conditional<Const, const SnowflakeMap *, SnowflakeMap *>::type map_pointer;
+		basic_iterator(map_pointer map, uint32_t slot) : map(map), slot(slot) {}
+
+		map_pointer map;
+		uint32_t slot;
+	};
+
+public:
+	typedef basic_iterator<false> iterator;
+	typedef basic_iterator<true> const_iterator;
+
+	SnowflakeMap() : element_count(0), slot_count(0) {}
+	~SnowflakeMap() { clear(); }
+
+	SnowflakeMap(const SnowflakeMap &) = delete;
+	SnowflakeMap &operator=(const SnowflakeMap &) = delete;
+
+	size_t size() const { return element_count; }
+	bool empty() const { return element_count == 0; }
+
+	iterator begin() { return iterator(this, next_used(0)); }
+	iterator end() { return iterator(this, slot_count); }
+	const_iterator begin() const { return const_iterator(this, next_used(0)); }
+	const_iterator end() const { return const_iterator(this, slot_count); }
+
+	iterator find(uint64_t key) {
+		size_t bucket = find_bucket(key);
+		return bucket == buckets.size() ? end() : iterator(this, buckets[bucket].slot);
+	}
+	const_iterator find(uint64_t key) const {
+		size_t bucket = find_bucket(key);
+		return bucket == buckets.size() ? end() : const_iterator(this, buckets[bucket].slot);
+	}
+	size_t count(uint64_t key) const {
+		return find_bucket(key) == buckets.size() ? 0 : 1;
+	}
+
+	// Constructs the element from args if key isn't present, returns (element, inserted)
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(uint64_t key, Args&&... args) {
+		size_t bucket = find_bucket(key);
+		if (bucket != buckets.size()) {
+			return { iterator(this, buckets[bucket].slot), false };
+		}
+
+		uint32_t slot = allocate_slot();
+		new (&slot_at(slot).storage) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+		slot_at(slot).used = true;
+
+		insert_bucket(key, slot);
+		return { iterator(this, slot), true };
+	}
+
+	T &operator[](uint64_t key) {
+		return emplace(key).first->second;
+	}
+
+	iterator erase(iterator it) {
+		uint32_t slot = it.slot;
+		++it;
+
+		size_t bucket = find_bucket(slot_at(slot).value().first);
+		erase_bucket(bucket);
+
+		slot_at(slot).value().~value_type();
+		slot_at(slot).used = false;
+		free_slots.push_back(slot);
+		element_count--;
+
+		return it;
+	}
+	size_t erase(uint64_t key) {
+		iterator it = find(key);
+		if (it == end()) {
+			return 0;
+		}
+		erase(it);
+		return 1;
+	}
+
+	void clear() {
+		for (uint32_t slot = 0; slot < slot_count; slot++) {
+			if (slot_at(slot).used) {
+				slot_at(slot).value().~value_type();
+			}
+		}
+		chunks.clear();
+		free_slots.clear();
+		buckets.clear();
+		element_count = slot_count = 0;
+	}
+
+	// Sizes the index for n elements, so it doesn't have to grow while they are inserted
+	void reserve(size_t n) {
+		size_t capacity = 16;
+		while (capacity * max_load_num < n * max_load_den) {
+			capacity *= 2;
+		}
+		if (capacity > buckets.size()) {
+			rehash(capacity);
+		}
+	}
+
+	// element slots which are allocated but not in use
+	size_t free_slot_count() const {
+		return chunks.size() * chunk_size - element_count;
+	}
+
+	std::string stats_string() const {
+		return std::to_string(element_count) + " live, " + std::to_string(free_slot_count()) + " free in " + std::to_string(chunks.size()) + " chunk(s)";
+	}
+
+	// Bytes used by the map itself, not counting anything the elements allocate
+	size_t memory_usage() const {
+		return chunks.size() * chunk_size * sizeof(Slot) + chunks.capacity() * sizeof(std::unique_ptr<Slot[]>)
+			+ buckets.capacity() * sizeof(Bucket) + free_slots.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	// the index grows past 7/8 full
+	static const size_t max_load_num = 7;
+	static const size_t max_load_den = 8;
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	std::vector<uint32_t> free_slots;
+	std::vector<Bucket> buckets; // size is 0 or a power of two
+	size_t element_count;
+	uint32_t slot_count; // slots handed out so far, used or free
+
+	Slot &slot_at(uint32_t slot) { return chunks[slot / chunk_size][slot % chunk_size]; }
+	const Slot &slot_at(uint32_t slot) const { return chunks[slot / chunk_size][slot % chunk_size]; }
+
+	uint32_t next_used(uint32_t slot) const {
+		while (slot < slot_count && !slot_at(slot).used) {
+			slot++;
+		}
+		return slot;
+	}
+
+	size_t home_bucket(uint64_t key) const {
+		// snowflakes are mostly timestamp, so mix the bits before masking
+		return (key * 0x9E3779B97F4A7C15ull) >> 32 & (buckets.size() - 1);
+	}
+
+	// buckets.size() if key isn't present
+	size_t find_bucket(uint64_t key) const {
+		if (buckets.empty()) {
+			return 0;
+		}
+
+		size_t mask = buckets.size() - 1;
+		for (size_t bucket = home_bucket(key);; bucket = (bucket + 1) & mask) {
+			if (buckets[bucket].slot == empty_slot) {
+				return buckets.size();
+			}
+			if (buckets[bucket].key == key) {
+				return bucket;
+			}
+		}
+	}
+
+	uint32_t allocate_slot() {
+		if (!free_slots.empty()) {
+			uint32_t slot = free_slots.back();
+			free_slots.pop_back();
+			return slot;
+		}
+
+		if (slot_count % chunk_size == 0) {
+			chunks.emplace_back(new Slot[chunk_size]);
+			for (uint32_t i = 0; i < chunk_size; i++) {
+				chunks.back()[i].used = false;
+			}
+		}
+		return slot_count++;
+	}
+
+	void insert_bucket(uint64_t key, uint32_t slot) {
+		element_count++;
+		if (buckets.size() * max_load_num < element_count * max_load_den) {
+			rehash(buckets.empty() ? 16 : buckets.size() * 2);
+		}
+
+		size_t mask = buckets.size() - 1;
+		size_t bucket = home_bucket(key);
+		while (buckets[bucket].slot != empty_slot) {
+			bucket = (bucket + 1) & mask;
+		}
+		buckets[bucket] = { key, slot };
+	}
+
+	void erase_bucket(size_t bucket) {
+		size_t mask = buckets.size() - 1;
+
+		// shift back any following entries which would no longer be reachable from their home bucket
+		size_t next = (bucket + 1) & mask;
+		while (buckets[next].slot != empty_slot) {
+			size_t home = home_bucket(buckets[next].key);
+			if (((next - home) & mask) >= ((next - bucket) & mask)) {
+				buckets[bucket] = buckets[next];
+				bucket = next;
+			}
+			next = (next + 1) & mask;
+		}
+		buckets[bucket].slot = empty_slot;
+	}
+
+	void rehash(size_t capacity) {
+		std::vector<Bucket> old;
+		old.swap(buckets);
+		buckets.assign(capacity, { 0, empty_slot });
+
+		size_t mask = capacity - 1;
+		for (const Bucket &b : old) {
+			if (b.slot == empty_slot) continue;
+
+			size_t bucket = home_bucket(b.key);
+			while (buckets[bucket].slot != empty_slot) {
+				bucket = (bucket + 1) & mask;
+			}
+			buckets[bucket] = b;
+		}
+	}
+};
+
+#endif
@@ -1,14 +1,13 @@
-#include <thread>
-#include <chrono>
-
 #include <curl/curl.h>
 #include <include/libplatform/libplatform.h>
 #include <include/v8.h>
 
-#include "ClientConnection.hpp"
+#include "ShardManager.hpp"
 #include "Logger.hpp"
 #include "DiscordAPI.hpp"
 #include "BotConfig.hpp"
+#include "http/HTTP.hpp"
+#include "js/CommandHelper.hpp"
 
 int main(int argc, char *argv[]) {
 	BotConfig config;
@@ -18,6 +17,9 @@ int main(int argc, char *argv[]) {
 	}
 
 	curl_global_init(CURL_GLOBAL_DEFAULT);
+	HTTP::start(config.rest_max_in_flight);
+	DiscordAPI::set_base_url(config.api_base_url);
+	DiscordAPI::set_coalesce_window(std::chrono::milliseconds(config.message_coalesce_ms));
 
 	v8::V8::InitializeICUDefaultLocation(argv[0]);
 	v8::V8::InitializeExternalStartupData(argv[0]);
@@ -27,37 +29,26 @@ int main(int argc, char *argv[]) {
 
 	Logger::write("Initialised V8 and curl", Logger::LogLevel::Debug);
 
-	std::string args = "/?v=5&encoding=json";
-	std::string url = DiscordAPI::get_gateway(config.cert_location).value("url", "wss://gateway.discord.gg");
-
-	bool retry = true;
-	int exit_code = 0;
-	while (retry) {
-		retry = false;
+	CommandHelper::init();
 
-		try {
-			ClientConnection conn(config);
-			conn.start(url + args);
-		}
-		catch (const std::exception &e) {
-			Logger::write("std exception: " + std::string(e.what()), Logger::LogLevel::Severe);
-			exit_code = 1;
-		}
-		catch (websocketpp::lib::error_code e) {
-			Logger::write("websocketpp exception: " + e.message(), Logger::LogLevel::Severe);
-			std::this_thread::sleep_for(std::chrono::seconds(10));
-			retry = true; // should just be an occasional connection issue
-		}
-		catch (...) {
-			Logger::write("other exception.", Logger::LogLevel::Severe);
-			exit_code = 2;
-		}
+	std::string args = "/?v=5&encoding=json";
+	if (config.gateway_compress) {
+		args += "&compress=zlib-stream";
+	}
+	std::string url = config.gateway_url;
+	if (url.empty()) {
+		url = DiscordAPI::get_gateway(config.cert_location).value("url", "wss://gateway.discord.gg");
 	}
 
+	ShardManager shards(config, url + args);
+	int exit_code = shards.run();
+
 	v8::V8::Dispose();
 	v8::V8::ShutdownPlatform();
 	delete platform;
 
+	DiscordAPI::flush_messages();
+	HTTP::cleanup();
 	curl_global_cleanup();
 
 	Logger::write("Cleaned up", Logger::LogLevel::Info);
@@ -14,6 +14,7 @@
 #include "data_structures/User.hpp"
 #include "Logger.hpp"
 #include "BotConfig.hpp"
+#include "MemoryUsage.hpp"
 
 TriviaGame::TriviaGame(BotConfig &c, GatewayHandler *gh, std::string channel_id, int total_questions, int delay) : config(c), interval(delay) {
 	this->gh = gh;
@@ -289,7 +290,7 @@ void TriviaGame::give_hint(int hints_given, std::string hint) {
 	DiscordAPI::send_message(channel_id, ":exclamation: Question failed. Answer: ** `" + *current_answers.begin() + "` **", config.token, config.cert_location);
 }
 
-void TriviaGame::handle_answer(std::string answer, DiscordObjects::User sender) {
+void TriviaGame::handle_answer(std::string answer, const DiscordObjects::User &sender) {
 	boost::algorithm::to_lower(answer);
 	if (current_answers.find(answer) != current_answers.end()) {
 		current_thread->interrupt();
@@ -315,6 +316,20 @@ void TriviaGame::handle_answer(std::string answer, DiscordObjects::User sender)
 	}
 }
 
+size_t TriviaGame::memory_usage() const {
+	// each map node is roughly the pair plus three pointers and a colour
+	const size_t node_overhead = 4 * sizeof(void *);
+
+	size_t usage = sizeof(TriviaGame);
+	for (auto &s : scores) {
+		usage += sizeof(s) + node_overhead + MemoryUsage::heap_bytes(s.first);
+	}
+	for (auto &t : average_times) {
+		usage += sizeof(t) + node_overhead + MemoryUsage::heap_bytes(t.first);
+	}
+	return usage;
+}
+
 void TriviaGame::increase_score(std::string user_id) {
 	if (scores.find(user_id) == scores.end()) { 
 		// user entry not found, add one
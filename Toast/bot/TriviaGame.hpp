@@ -23,7 +23,10 @@ public:
 
 	void start();
 	void interrupt();
-	void handle_answer(std::string answer, DiscordObjects::User sender);
+	void handle_answer(std::string answer, const DiscordObjects::User &sender);
+
+	// roughly, for `debug memory`. Scores only change in handle_answer, so call it under the same lock.
+	size_t memory_usage() const;
 
 private:
 	BotConfig &config;
@@ -2,9 +2,12 @@
 #define BOT_DATA__STRUCTURES_CHANNEL
 
 #include <string>
+#include <cstdint>
 
 #include "../json/json.hpp"
 
+#include "../Snowflake.hpp"
+
 using json = nlohmann::json;
 
 namespace DiscordObjects {
@@ -28,44 +31,49 @@ namespace DiscordObjects {
 
 	class Channel {
 	public:
+		enum class Type : uint8_t {
+			Text, Voice
+		};
+
 		Channel();
-		Channel(json data);
+		Channel(const json &data);
 
-		void load_from_json(json data);
+		void load_from_json(const json &data);
 		std::string to_debug_string();
+		std::string type_string() const;
 
 		bool operator==(Channel rhs);
 
-		std::string id;
-		std::string guild_id;
+		Snowflake id;
+		Snowflake guild_id;
+		Snowflake last_message_id;
 		std::string name;
-		std::string type;
-		int position;
-		bool is_private;
+		std::string topic;
 		// TODO: Implement permission overwrites
 		// std::vector<Permission_Overwrite> permission_overwrites;
-		std::string topic;
-		std::string last_message_id;
-		int bitrate;
-		int user_limit;
+		int32_t position;
+		int32_t bitrate;
+		int32_t user_limit;
+		Type type;
+		bool is_private : 1;
 	};
 
 	inline Channel::Channel() {
-		id = guild_id = name = topic = last_message_id = "null";
+		name = topic = "null";
 		position = bitrate = user_limit = -1;
 		is_private = false;
-		type = "text";
+		type = Type::Text;
 	}
 
-	inline Channel::Channel(json data) : Channel() {
+	inline Channel::Channel(const json &data) : Channel() {
 		load_from_json(data);
 	}
 
-	inline void Channel::load_from_json(json data) {
+	inline void Channel::load_from_json(const json &data) {
 		id = data.value("id", "null");
 		guild_id = data.value("guild_id", "null");
 		name = data.value("name", "null");
-		type = data.value("type", "text");
+		type = data.value("type", "text") == "voice" ? Type::Voice : Type::Text;
 		position = data.value("position", -1);
 		is_private = data.value("is_private", false);
 		topic = data.value("topic", "null");
@@ -78,7 +86,7 @@ namespace DiscordObjects {
 		return "**__Channel " + id + "__**"
 			+ "\n**guild_id:** " + guild_id
 			+ "\n**name:** " + name
-			+ "\n**type:** " + type
+			+ "\n**type:** " + type_string()
 			+ "\n**position:** " + std::to_string(position)
 			+ "\n**is_private:** " + std::to_string(is_private)
 			+ "\n**topic:** " + (topic == "" ? "[empty]" : topic)
@@ -87,8 +95,12 @@ namespace DiscordObjects {
 			+ "\n**user_limit:** " + std::to_string(user_limit);
 	}
 
+	inline std::string Channel::type_string() const {
+		return type == Type::Voice ? "voice" : "text";
+	}
+
 	inline bool Channel::operator==(Channel rhs) {
-		return id == rhs.id && id != "null";
+		return id == rhs.id && id != Snowflake();
 	}
 }
 
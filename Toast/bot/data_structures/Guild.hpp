@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include "../json/json.hpp"
 
@@ -11,6 +12,8 @@
 #include "User.hpp"
 #include "Role.hpp"
 #include "GuildMember.hpp"
+#include "../SnowflakeMap.hpp"
+#include "../Slab.hpp"
 
 using json = nlohmann::json;
 
@@ -42,26 +45,44 @@ namespace DiscordObjects {
 	|-------------------|---------------|-----------------------------------------------|
 	|channels			|array			|array of channel object ptrs                   |
 	|users				|array			|array of user objects ptrs                     |
+	|member_count		|integer		|total members, from GUILD_CREATE				|
+	|member_list		|enum			|how much of the member list is loaded			|
+	|from_snapshot		|bool			|loaded from a snapshot, not yet sent again		|
+	|view_epoch			|integer		|cache epoch of the guild's last change			|
 	-------------------------------------------------------------------------------------
 	*/
 
 	class Guild {
 	public:
+		/* Large guilds only send online members in GUILD_CREATE, the rest come in GUILD_MEMBERS_CHUNKs on request */
+		enum class MemberList {
+			Partial, Requested, Complete
+		};
+
 		Guild();
-		Guild(json data);
+		Guild(const json &data);
 
-		void load_from_json(json data);
+		void load_from_json(const json &data);
 		std::string to_debug_string();
+		std::string member_list_string();
+
+		/* members must only be changed through these, to keep member_index and member_slab in sync */
+		GuildMember *find_member(uint64_t user_id);
+		// the user must not already be a member
+		GuildMember *add_member(const json &data, User *user);
+		GuildMember *add_member(User *user);
+		// Deletes the member, the members after it move down one. false if they aren't a member.
+		bool remove_member(uint64_t user_id);
 
 		bool operator==(Guild rhs);
 
-		std::string id;
+		Snowflake   id;
 		std::string	name;
 		std::string	icon;
 		std::string	splash;
-		std::string	owner_id;
+		Snowflake   owner_id;
 		std::string	region;
-		std::string	afk_channel_id;
+		Snowflake   afk_channel_id;
 		int	        afk_timeout;
 		// bool        embed_enabled;
 		// std::string	embed_channel_id;
@@ -74,20 +95,33 @@ namespace DiscordObjects {
 
 		std::vector<Channel *> channels;
 		std::vector<GuildMember *> members;
+		// <user id, index in members>
+		std::unordered_map<uint64_t, size_t> member_index;
+		// owns the GuildMembers, so they are all freed with the guild
+		Slab<GuildMember> member_slab;
 		std::vector<Role *> roles;
+		int member_count;
+		MemberList member_list;
+		bool from_snapshot; // see CacheSnapshot, cleared when the GUILD_CREATE arrives
+		uint64_t view_epoch; // see GatewayHandler::get_guild_view
 		//std::vector<std::unique_ptr<DiscordObjects::User>>    users;
 	};
 
 	inline Guild::Guild() {
-		id = name = icon = splash = owner_id = region = afk_channel_id = "null";
+		name = icon = splash = region = "null";
 		afk_timeout = verification_level = -1;
+		unavailable = false;
+		member_count = 0;
+		member_list = MemberList::Complete;
+		from_snapshot = false;
+		view_epoch = 0;
 	}
 
-	inline Guild::Guild(json data) : Guild() {
+	inline Guild::Guild(const json &data) : Guild() {
 		load_from_json(data);
 	}
 
-	inline void Guild::load_from_json(json data) {
+	inline void Guild::load_from_json(const json &data) {
 		id = data.value("id", "null");
 		name = data.value("name", "null");
 		icon = data.value("icon", "null");
@@ -113,11 +147,61 @@ namespace DiscordObjects {
 			+ "\n**unavailable:** " + std::to_string(unavailable)
 			+ "\n**channels:** " + std::to_string(channels.size())
 			+ "\n**roles:** " + std::to_string(roles.size())
-			+ "\n**members:** " + std::to_string(members.size());
+			+ "\n**members:** " + std::to_string(members.size()) + "/" + std::to_string(member_count) + " (" + member_list_string() + ")"
+			+ "\n**member slab:** " + member_slab.stats_string()
+			+ "\n**from snapshot:** " + std::to_string(from_snapshot);
+	}
+
+	inline std::string Guild::member_list_string() {
+		switch (member_list) {
+		case MemberList::Partial: return "partial";
+		case MemberList::Requested: return "loading";
+		case MemberList::Complete: return "complete";
+		}
+		return "unknown";
+	}
+
+	inline GuildMember *Guild::find_member(uint64_t user_id) {
+		auto it = member_index.find(user_id);
+		return it == member_index.end() ? nullptr : members[it->second];
+	}
+
+	inline GuildMember *Guild::add_member(const json &data, User *user) {
+		GuildMember *member = add_member(user);
+		member->load_from_json(data);
+		return member;
+	}
+
+	inline GuildMember *Guild::add_member(User *user) {
+		GuildMember *member = member_slab.create();
+		member->user = user;
+		member_index[user->id] = members.size();
+		members.push_back(member);
+		return member;
+	}
+
+	inline bool Guild::remove_member(uint64_t user_id) {
+		auto it = member_index.find(user_id);
+		if (it == member_index.end()) {
+			return false;
+		}
+
+		size_t index = it->second;
+		GuildMember *member = members[index];
+		member_index.erase(it);
+
+		// erased in place, so the members after it keep their order (JS server.Users relies on it) and move down one
+		members.erase(members.begin() + index);
+		for (size_t i = index; i < members.size(); i++) {
+			member_index[members[i]->user->id] = i;
+		}
+
+		member_slab.destroy(member);
+		return true;
 	}
 
 	inline bool Guild::operator==(Guild rhs) {
-		return id == rhs.id && id != "null";
+		return id == rhs.id && id != Snowflake();
 	}
 }
 
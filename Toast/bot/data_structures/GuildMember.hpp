@@ -3,62 +3,74 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include "../json/json.hpp"
 
+#include "../InternedString.hpp"
+
 #include "User.hpp"
 #include "Role.hpp"
+#include "Timestamp.hpp"
 
 namespace DiscordObjects {
 	class GuildMember {
 	public:
 		GuildMember();
-		GuildMember(json data, User *user);
+		GuildMember(const json &data, User *user);
 
-		void load_from_json(json data);
+		void load_from_json(const json &data);
 		std::string to_debug_string();
 
 		bool operator==(GuildMember rhs);
+		bool has_permission(Permission permission) const { return (permissions & static_cast<uint32_t>(permission)) != 0; }
 
 		User *user;
-		std::string nick;
+		InternedString nick; // usually "null"
 		std::vector<Role *> roles;
-		std::string joined_at; // TODO: better type
-		bool deaf;
-		bool mute;
+		int64_t joined_at; // unix ms
+		// guild-wide, channel overwrites aren't cached. Kept up to date by GatewayHandler::update_permissions.
+		uint32_t permissions;
+		bool deaf : 1;
+		bool mute : 1;
+		bool js_allowed : 1; // has a role in v8.js_allowed_roles, also kept by update_permissions
 	};
 
 	inline GuildMember::GuildMember() {
 		user = nullptr;
-		nick = joined_at = "null";
+		joined_at = 0;
+		permissions = 0;
 		deaf = false;
 		mute = false;
+		js_allowed = false;
 	}
 
-	inline GuildMember::GuildMember(json data, User *user) : GuildMember() {
+	inline GuildMember::GuildMember(const json &data, User *user) : GuildMember() {
 		this->user = user;
 		load_from_json(data);
 	}
 
-	inline void GuildMember::load_from_json(json data) {
+	inline void GuildMember::load_from_json(const json &data) {
 		nick = data.value("nick", "null");
-		joined_at = data.value("joined_at", "null");
+		joined_at = parse_timestamp(data.value("joined_at", "null"));
 		deaf = data.value("deaf", false);
 		mute = data.value("mute", false);
 	}
 
 	inline std::string GuildMember::to_debug_string() {
 		return "**__GuildMember " + user->id + "__**"
-			+ "\n**mention:** <@" + user->id + "> / " + user->username + "#" + user->discriminator
+			+ "\n**mention:** <@" + user->id + "> / " + user->username + "#" + user->discriminator_string()
 			+ "\n**bot:** " + std::to_string(user->bot)
 			+ "\n**mfa_enabled:** " + std::to_string(user->mfa_enabled)
-			+ "\n**avatar:** " + user->avatar
-			+ "\n**status:** " + user->status
+			+ "\n**avatar:** " + user->avatar_string()
+			+ "\n**status:** " + user->status_string()
 			+ "\n**game name:** " + user->game
 			+ "\n**nick:** " + nick
-			+ "\n**joined_at:** " + joined_at
+			+ "\n**joined_at:** " + timestamp_string(joined_at)
 			+ "\n**deaf:** " + std::to_string(deaf)
-			+ "\n**mute:** " + std::to_string(mute);
+			+ "\n**mute:** " + std::to_string(mute)
+			+ "\n**permissions:** " + std::to_string(permissions)
+			+ "\n**js allowed:** " + std::to_string(js_allowed);
 	}
 
 	inline bool GuildMember::operator==(GuildMember rhs) {
@@ -4,9 +4,13 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <cstdint>
 
 #include "../json/json.hpp"
 
+#include "../InternedString.hpp"
+#include "../Snowflake.hpp"
+
 using json = nlohmann::json;
 
 namespace DiscordObjects {
@@ -14,26 +18,24 @@ namespace DiscordObjects {
 	class Role {
 	public:
 		Role();
-		Role(json data);
+		Role(const json &data);
 
-		void load_from_json(json data);
+		void load_from_json(const json &data);
 		std::string to_debug_string();
 
 		bool operator==(Role rhs);
 
-		std::string id;
-		std::string name;
-		int colour;
-		bool hoist;
-		int position;
-		int permissions;
-		bool managed;
-		bool mentionable;
+		Snowflake id;
+		InternedString name; // every guild has an @everyone, and many have the same few others
+		int32_t colour;
+		int32_t position;
+		uint32_t permissions;
+		bool hoist : 1;
+		bool managed : 1;
+		bool mentionable : 1;
 	};
 
 	inline Role::Role() {
-		id = "null";
-		name = "null";
 		colour = -1;
 		hoist = false;
 		position = -1;
@@ -42,11 +44,11 @@ namespace DiscordObjects {
 		mentionable = false;
 	}
 
-	inline Role::Role(json data) : Role() {
+	inline Role::Role(const json &data) : Role() {
 		load_from_json(data);
 	}
 
-	inline void Role::load_from_json(json data) {
+	inline void Role::load_from_json(const json &data) {
 		id = data.value("id", "null");
 		name = data.value("name", "null");
 		colour = data.value("color", -1);
@@ -0,0 +1,76 @@
+#ifndef BOT_DATA__STRUCTURES_TIMESTAMP
+#define BOT_DATA__STRUCTURES_TIMESTAMP
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+namespace DiscordObjects {
+	/* ISO 8601 timestamps as sent by Discord (e.g. 2016-12-03T21:07:58.451000+00:00), stored as ms since the unix epoch */
+
+	// days since 1970-01-01 of a proleptic Gregorian date
+	inline int64_t days_from_civil(int64_t year, int month, int day) {
+		year -= month <= 2;
+		int64_t era = (year >= 0 ? year : year - 399) / 400;
+		int64_t year_of_era = year - era * 400;
+		int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+		int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+		return era * 146097 + day_of_era - 719468;
+	}
+
+	// 0 if it can't be parsed
+	inline int64_t parse_timestamp(const std::string &timestamp) {
+		int year, month, day, hour, minute, second;
+		if (std::sscanf(timestamp.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+			return 0;
+		}
+
+		int64_t ms = ((days_from_civil(year, month, day) * 24 + hour) * 60 + minute) * 60000 + second * 1000;
+
+		size_t pos = 19;
+		if (pos < timestamp.length() && timestamp[pos] == '.') {
+			int scale = 100;
+			for (pos++; pos < timestamp.length() && timestamp[pos] >= '0' && timestamp[pos] <= '9'; pos++) {
+				ms += (timestamp[pos] - '0') * scale;
+				scale /= 10;
+			}
+		}
+
+		int offset_hours, offset_minutes;
+		if (pos < timestamp.length() && (timestamp[pos] == '+' || timestamp[pos] == '-')
+			&& std::sscanf(timestamp.c_str() + pos + 1, "%2d:%2d", &offset_hours, &offset_minutes) == 2) {
+			int64_t offset = (offset_hours * 60 + offset_minutes) * 60000;
+			ms += timestamp[pos] == '+' ? -offset : offset;
+		}
+
+		return ms;
+	}
+
+	// "null" for 0
+	inline std::string timestamp_string(int64_t ms) {
+		if (ms == 0) {
+			return "null";
+		}
+
+		int64_t days = (ms >= 0 ? ms : ms - 86399999) / 86400000;
+		int64_t ms_of_day = ms - days * 86400000;
+
+		// inverse of days_from_civil
+		days += 719468;
+		int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+		int64_t day_of_era = days - era * 146097;
+		int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+		int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+		int64_t mp = (5 * day_of_year + 2) / 153;
+		int day = static_cast<int>(day_of_year - (153 * mp + 2) / 5 + 1);
+		int month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+		long long year = year_of_era + era * 400 + (month <= 2);
+
+		char buffer[40];
+		std::snprintf(buffer, sizeof(buffer), "%04lld-%02d-%02dT%02d:%02d:%02d.%03d+00:00", year, month, day,
+			static_cast<int>(ms_of_day / 3600000), static_cast<int>(ms_of_day / 60000 % 60), static_cast<int>(ms_of_day / 1000 % 60), static_cast<int>(ms_of_day % 1000));
+		return buffer;
+	}
+}
+
+#endif
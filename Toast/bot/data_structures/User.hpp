@@ -3,9 +3,15 @@
 
 #include <string>
 #include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
 
 #include "../json/json.hpp"
 
+#include "../InternedString.hpp"
+#include "../Snowflake.hpp"
+
 using json = nlohmann::json;
 
 namespace DiscordObjects {
@@ -25,48 +31,127 @@ namespace DiscordObjects {
 
 	class User {
 	public:
+		enum class Status : uint8_t {
+			Online, Idle, DoNotDisturb, Offline
+		};
+
 		User();
-		User(json data);
+		User(const json &data);
+
+		void load_from_json(const json &data);
+		void set_status(const std::string &status);
 
-		void load_from_json(json data);
+		std::string status_string() const;
+		std::string discriminator_string() const;
+		std::string avatar_string() const;
 
 		bool operator==(User rhs);
 
-		std::string id;
+		Snowflake id;
 		std::string username;
-		std::string discriminator;
-		std::string avatar;
-		bool bot;
-		bool mfa_enabled;
 
-		// presence
-		std::string game;
-		std::string status;
+		// presence, interned as most users share a handful of values
+		InternedString game;
+
+		std::vector<uint64_t> guilds; // ids of the guilds the user is in, they are removed from the cache when it's empty
+
+		uint8_t avatar[16]; // the hash's 32 hex digits as bytes, see avatar_string()
+		uint16_t discriminator;
+		Status status;
+		bool bot : 1;
+		bool mfa_enabled : 1;
+		bool has_avatar : 1;
+		bool animated_avatar : 1; // hash has an "a_" prefix
 
-		std::vector<std::string> guilds;
+	private:
+		void set_avatar(const std::string &hash);
 	};
 
 	inline User::User() {
-		id = username = discriminator = avatar = game = "null";
-		status = "offline";
-		bot = mfa_enabled = false;
+		username = "null";
+		discriminator = 0;
+		status = Status::Offline;
+		bot = mfa_enabled = has_avatar = animated_avatar = false;
+		std::fill(std::begin(avatar), std::end(avatar), 0);
 	}
 
-	inline User::User(json data) : User() {
+	inline User::User(const json &data) : User() {
 		load_from_json(data);
 	}
 
-	inline void User::load_from_json(json data) {
+	inline void User::load_from_json(const json &data) {
 		id = data.value("id", "null");
 		username = data.value("username", "null");
-		discriminator = data.value("discriminator", "null");
-		avatar = data.value("avatar", "null");
+		discriminator = static_cast<uint16_t>(to_snowflake(data.value("discriminator", "0")));
+		set_avatar(data.value("avatar", "null"));
 		bot = data.value("bot", false);
 		mfa_enabled = data.value("mfa_enabled", false);
 	}
 
+	inline void User::set_status(const std::string &status_name) {
+		if (status_name == "online") status = Status::Online;
+		else if (status_name == "idle") status = Status::Idle;
+		else if (status_name == "dnd") status = Status::DoNotDisturb;
+		else status = Status::Offline; // including invisible, which is how others see it
+	}
+
+	inline std::string User::status_string() const {
+		switch (status) {
+		case Status::Online: return "online";
+		case Status::Idle: return "idle";
+		case Status::DoNotDisturb: return "dnd";
+		case Status::Offline: return "offline";
+		}
+		return "offline";
+	}
+
+	inline std::string User::discriminator_string() const {
+		if (discriminator == 0) {
+			return "null";
+		}
+
+		std::string digits = std::to_string(discriminator);
+		return std::string(digits.length() < 4 ? 4 - digits.length() : 0, '0') + digits;
+	}
+
+	inline void User::set_avatar(const std::string &hash) {
+		// zeros without an avatar, so snapshots of the same user are the same bytes
+		std::fill(std::begin(avatar), std::end(avatar), 0);
+		animated_avatar = hash.compare(0, 2, "a_") == 0;
+		size_t start = animated_avatar ? 2 : 0;
+		has_avatar = hash.length() == start + 2 * sizeof(avatar);
+
+		for (size_t i = 0; has_avatar && i < 2 * sizeof(avatar); i++) {
+			char c = hash[start + i];
+			int value;
+			if (c >= '0' && c <= '9') value = c - '0';
+			else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+			else {
+				has_avatar = false; // not a hash we know how to store, treat it as no avatar
+				break;
+			}
+
+			if (i % 2 == 0) avatar[i / 2] = value << 4;
+			else avatar[i / 2] |= value;
+		}
+	}
+
+	inline std::string User::avatar_string() const {
+		if (!has_avatar) {
+			return "null";
+		}
+
+		const char digits[] = "0123456789abcdef";
+		std::string hash = animated_avatar ? "a_" : "";
+		for (uint8_t byte : avatar) {
+			hash += digits[byte >> 4];
+			hash += digits[byte & 0xF];
+		}
+		return hash;
+	}
+
 	inline bool User::operator==(User rhs) {
-		return id == rhs.id && id != "null";
+		return id == rhs.id && id != Snowflake();
 	}
 }
 
@@ -1,102 +1,103 @@
 #include "HTTP.hpp"
 
+#include <mutex>
+#include <future>
+#include <memory>
+
+#include "HandlePool.hpp"
+#include "RestClient.hpp"
 #include "../Logger.hpp"
-#include "../BotConfig.hpp"
 
-/*
-*  Warning: (Awful) C Code
-*/
 namespace HTTP {
-	size_t write_callback(void *contents, size_t size, size_t nmemb, void *read_buffer) {
-		static_cast<std::string *>(read_buffer)->append(static_cast<char *>(contents), size * nmemb);
-		return size * nmemb;
+	const size_t default_max_in_flight = 8;
+	// how long cleanup waits for requests to finish
+	const std::chrono::milliseconds cleanup_timeout(5000);
+
+	// never destroyed, as that would run after curl_global_cleanup. cleanup() closes it.
+	HandlePool &pool() {
+		static HandlePool *p = new HandlePool();
+		return *p;
 	}
 
-	std::string post_request(std::string url, std::string content_type, std::string data, long *response_code, std::string token, std::string ca_location) {
-		CURL *curl;
-		CURLcode res;
-		std::string read_buffer;
-		struct curl_slist *headers = nullptr;
-
-		curl = curl_easy_init();
-		if (curl) {
-			curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-
-			// Now with real HTTPS!
-			curl_easy_setopt(curl, CURLOPT_CAINFO, ca_location.c_str());
-
-			std::string header_arr[3];
-			header_arr[0] = "Content-Type: " + content_type;
-			header_arr[1] = "Authorization: Bot " + token;
-			header_arr[2] = "User-Agent: DiscordBot(http://github.com/jackb-p/triviadiscord, 1.0)";
-
-			for (std::string h : header_arr) {
-				headers = curl_slist_append(headers, h.c_str());
-			}
-
-			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
+	std::mutex client_mutex;
+	std::shared_ptr<RestClient> rest_client;
+	bool cleaned_up = false;
 
-			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-
-			res = curl_easy_perform(curl);
-
-			if (res == CURLE_OK) {
-				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, response_code);
-			}
-			else {
-				return "";
-			}
-
-			curl_easy_cleanup(curl);
-			curl_slist_free_all(headers);
+	// nullptr after cleanup
+	std::shared_ptr<RestClient> client(size_t max_in_flight = default_max_in_flight) {
+		std::lock_guard<std::mutex> lock(client_mutex);
+		if (!rest_client && !cleaned_up) {
+			rest_client = std::make_shared<RestClient>(pool(), max_in_flight);
 		}
-
-		return read_buffer;
+		return rest_client;
 	}
 
-	std::string get_request(std::string url, long *response_code, std::string token, std::string ca_location) {
-		CURL *curl;
-		CURLcode res;
-		std::string read_buffer;
-		struct curl_slist *headers = nullptr;
-
-		curl = curl_easy_init();
-		if (curl) {
-			curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-
-			// Now with real HTTPS!
-			curl_easy_setopt(curl, CURLOPT_CAINFO, ca_location.c_str());
+	void start(size_t max_in_flight) {
+		client(max_in_flight);
+	}
 
-			std::string header_arr[2];
-			header_arr[0] = "Authorization: Bot " + token;
-			header_arr[1] = "User-Agent: DiscordBot (http://github.com/jackb-p/triviadiscord, 1.0)";
+	void request(Request request, Callback callback) {
+		std::shared_ptr<RestClient> c = client();
+		if (!c) {
+			Logger::write("[rest] Request to " + request.url + " after cleanup, dropped", Logger::LogLevel::Warning);
+			return;
+		}
+		c->submit(std::move(request), std::move(callback));
+	}
 
-			for (std::string h : header_arr) {
-				headers = curl_slist_append(headers, h.c_str());
-			}
+	Response request_sync(Request request) {
+		std::shared_ptr<std::promise<Response>> promise = std::make_shared<std::promise<Response>>();
+		std::future<Response> response = promise->get_future();
 
-			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+		std::shared_ptr<RestClient> c = client();
+		if (!c) {
+			Response dropped;
+			dropped.error = "requested after cleanup";
+			return dropped;
+		}
+		c->submit(std::move(request), [promise](const Response &r) {
+			promise->set_value(r);
+		});
 
-			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &HTTP::write_callback);
-			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
+		// a request dropped by stop() never sets the promise
+		try {
+			return response.get();
+		}
+		catch (const std::future_error &) {
+			Response dropped;
+			dropped.error = "dropped on cleanup";
+			return dropped;
+		}
+	}
 
-			res = curl_easy_perform(curl);
+	void after(std::chrono::milliseconds delay, std::function<void()> fn) {
+		std::shared_ptr<RestClient> c = client();
+		if (c) {
+			c->after(delay, std::move(fn));
+		}
+	}
 
-			if (res == CURLE_OK) {
-				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, response_code);
-			}
-			else {
-				Logger::write("curl error: " + std::string(curl_easy_strerror(res)), Logger::LogLevel::Warning);
-				return read_buffer;
-			}
+	std::string stats_string() {
+		std::shared_ptr<RestClient> c;
+		{
+			std::lock_guard<std::mutex> lock(client_mutex);
+			c = rest_client;
+		}
+		return c ? c->stats_string() : "\n**rest requests:** none";
+	}
 
-			curl_easy_cleanup(curl);
-			curl_slist_free_all(headers);
+	void cleanup() {
+		std::shared_ptr<RestClient> c;
+		{
+			std::lock_guard<std::mutex> lock(client_mutex);
+			c = std::move(rest_client);
+			cleaned_up = true;
+		}
+		if (c) {
+			c->stop(cleanup_timeout);
 		}
+		c.reset();
 
-		return read_buffer;
+		pool().cleanup();
 	}
-}
\ No newline at end of file
+}
@@ -1,15 +1,55 @@
 #ifndef BOT_HTTP_HTTP
 #define BOT_HTTP_HTTP
 
-#include <iostream>
+#include <map>
+#include <chrono>
+#include <string>
+#include <cstddef>
+#include <functional>
 
-#include <curl/curl.h>
+/*
+* REST requests, made by one RestClient per process. Requests never block the caller: they are queued, made on the
+* client's thread, and the callback is run there with the response. Safe to call from any thread.
+*/
+namespace HTTP {
+	struct Request {
+		std::string method = "GET";	// GET or POST
+		std::string url;
+		std::string content_type;	// of the body, POST only
+		std::string body;
+		std::string token;		// sent as "Authorization: Bot <token>" if not empty
+		std::string ca_location;
 
-class BotConfig;
+		// requests with the same queue (e.g. messages to a channel) are made one at a time, in order. Empty for none.
+		std::string queue;
+		// times to try again after a connection failure or 5xx response
+		int retries = 2;
+	};
 
-namespace HTTP {
-	std::string post_request(std::string url, std::string content_type, std::string data, long *response_code, std::string token, std::string ca_location);
-	std::string get_request(std::string url, long *response_code, std::string token, std::string ca_location);
+	struct Response {
+		long code = 0;		// 0 if there was no response
+		std::string body;
+		std::map<std::string, std::string> headers; // names in lower case
+		std::string error;	// curl's, when code is 0
+	};
+
+	// runs on the client's thread, so must not block (or make a request_sync)
+	typedef std::function<void(const Response &response)> Callback;
+
+	// Starts the client with at most max_in_flight requests at a time. Otherwise it starts with 8 on the first request.
+	void start(size_t max_in_flight);
+	void request(Request request, Callback callback = nullptr);
+	// Blocks the caller until the response arrives. Not for use in callbacks.
+	Response request_sync(Request request);
+	// Runs fn on the client's thread after delay, e.g. to gather work into fewer requests. Like a callback it must not
+	// block, and it is dropped by cleanup().
+	void after(std::chrono::milliseconds delay, std::function<void()> fn);
+
+	// requests, queues, connections and the handle pool
+	std::string stats_string();
+	// finishes what's queued (for a few seconds at most) and closes every connection, before curl_global_cleanup.
+	// No requests can be made after.
+	void cleanup();
 }
 
-#endif
\ No newline at end of file
+#endif
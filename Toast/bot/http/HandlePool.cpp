@@ -0,0 +1,137 @@
+#include "HandlePool.hpp"
+
+#include <cctype>
+
+namespace HTTP {
+	const std::string user_agent = "User-Agent: DiscordBot (http://github.com/jackb-p/triviadiscord, 1.0)";
+
+	size_t write_callback(void *contents, size_t size, size_t nmemb, void *read_buffer) {
+		static_cast<std::string *>(read_buffer)->append(static_cast<char *>(contents), size * nmemb);
+		return size * nmemb;
+	}
+
+	// called once per line, status line included
+	size_t header_callback(char *buffer, size_t size, size_t nitems, void *headers) {
+		std::map<std::string, std::string> &map = *static_cast<std::map<std::string, std::string> *>(headers);
+		std::string line(buffer, size * nitems);
+
+		if (line.compare(0, 5, "HTTP/") == 0) {
+			map.clear(); // only the final response's (e.g. not a 100 Continue's)
+			return size * nitems;
+		}
+
+		size_t colon = line.find(':');
+		if (colon != std::string::npos) {
+			std::string name = line.substr(0, colon);
+			for (char &c : name) {
+				c = std::tolower(static_cast<unsigned char>(c));
+			}
+			size_t value_start = line.find_first_not_of(" \t", colon + 1);
+			size_t value_end = line.find_last_not_of(" \t\r\n");
+			map[name] = value_start == std::string::npos || value_end < value_start ? "" : line.substr(value_start, value_end - value_start + 1);
+		}
+		return size * nitems;
+	}
+
+	Handle::~Handle() {
+		curl_slist_free_all(headers);
+		curl_easy_cleanup(curl);
+	}
+
+	void Handle::prepare(const Request &request, Response *response) {
+		std::string type = request.method == "POST" ? request.content_type : "";
+		if (!headers || token != request.token || content_type != type) {
+			curl_slist_free_all(headers);
+			headers = nullptr;
+			if (!type.empty()) {
+				headers = curl_slist_append(headers, ("Content-Type: " + type).c_str());
+			}
+			if (!request.token.empty()) {
+				headers = curl_slist_append(headers, ("Authorization: Bot " + request.token).c_str());
+			}
+			headers = curl_slist_append(headers, user_agent.c_str());
+			token = request.token;
+			content_type = type;
+		}
+
+		curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+		curl_easy_setopt(curl, CURLOPT_CAINFO, request.ca_location.c_str());
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response->body);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response->headers);
+		if (request.method == "POST") {
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.body.c_str());
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.body.size()));
+		}
+		else {
+			curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+		}
+	}
+
+	HandlePool::HandlePool() : handles_created(0) {
+		share = curl_share_init();
+		curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &HandlePool::lock);
+		curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &HandlePool::unlock);
+		curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 // 7.57.0
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	}
+
+	void HandlePool::lock(CURL *, curl_lock_data data, curl_lock_access, void *pool) {
+		static_cast<HandlePool *>(pool)->share_mutexes[data].lock();
+	}
+
+	void HandlePool::unlock(CURL *, curl_lock_data data, void *pool) {
+		static_cast<HandlePool *>(pool)->share_mutexes[data].unlock();
+	}
+
+	std::unique_ptr<Handle> HandlePool::acquire() {
+		{
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			if (!share) {
+				return nullptr;
+			}
+			if (!idle.empty()) {
+				std::unique_ptr<Handle> handle = std::move(idle.back());
+				idle.pop_back();
+				return handle;
+			}
+			handles_created++;
+		}
+
+		CURL *curl = curl_easy_init();
+		if (!curl) {
+			return nullptr;
+		}
+
+		// options which are the same for every request
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &HTTP::write_callback);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &HTTP::header_callback);
+		return std::make_unique<Handle>(curl);
+	}
+
+	void HandlePool::release(std::unique_ptr<Handle> handle) {
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		if (share && idle.size() < max_idle_handles) {
+			idle.push_back(std::move(handle));
+		}
+	}
+
+	void HandlePool::cleanup() {
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		idle.clear();
+		curl_share_cleanup(share);
+		share = nullptr;
+	}
+
+	std::string HandlePool::stats_string() {
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		return std::to_string(handles_created) + " handle(s) created, " + std::to_string(idle.size()) + " idle";
+	}
+}
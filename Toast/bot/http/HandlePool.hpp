@@ -0,0 +1,71 @@
+#ifndef BOT_HTTP_HANDLEPOOL
+#define BOT_HTTP_HANDLEPOOL
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <curl/curl.h>
+
+#include "HTTP.hpp"
+
+namespace HTTP {
+	// An easy handle, and the headers last used on it which are only rebuilt when the token or content type change
+	class Handle {
+	public:
+		Handle(CURL *curl) : curl(curl), headers(nullptr) {}
+		~Handle();
+
+		Handle(const Handle &) = delete;
+		Handle &operator=(const Handle &) = delete;
+
+		// sets the request's options, the response is read into response. Both must outlive the transfer.
+		void prepare(const Request &request, Response *response);
+
+		CURL *const curl;
+
+	private:
+		curl_slist *headers;
+		std::string token;
+		std::string content_type;
+	};
+
+	/*
+	* Easy handles are pooled rather than made per request. A handle keeps its options and connection between requests,
+	* and every handle shares one DNS, TLS session and connection cache, so a request only pays for a handshake when no
+	* connection to the host is open.
+	*/
+	class HandlePool {
+	public:
+		HandlePool();
+
+		HandlePool(const HandlePool &) = delete;
+		HandlePool &operator=(const HandlePool &) = delete;
+
+		// nullptr if curl couldn't make a handle
+		std::unique_ptr<Handle> acquire();
+		void release(std::unique_ptr<Handle> handle);
+		// closes the idle handles and the share. Nothing can be acquired after.
+		void cleanup();
+
+		std::string stats_string();
+
+	private:
+		// handles beyond this many are closed when they are released, rather than kept idle
+		static const size_t max_idle_handles = 8;
+
+		static void lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *pool);
+		static void unlock(CURL *curl, curl_lock_data data, void *pool);
+
+		CURLSH *share;
+		std::mutex share_mutexes[CURL_LOCK_DATA_LAST];
+
+		std::mutex idle_mutex;
+		std::vector<std::unique_ptr<Handle>> idle;
+		unsigned long handles_created;
+	};
+}
+
+#endif
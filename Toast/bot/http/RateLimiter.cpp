@@ -0,0 +1,192 @@
+#include "RateLimiter.hpp"
+
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+
+#include "../json/json.hpp"
+
+using json = nlohmann::json;
+
+RateLimiter::RateLimiter() {
+	global_used = 0;
+	delayed = limited = global_limited = 0;
+}
+
+std::string RateLimiter::route(const std::string &method, const std::string &url) {
+	size_t scheme = url.find("://");
+	size_t start = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+	if (start == std::string::npos) {
+		return method + " /";
+	}
+	std::string path = url.substr(start, url.find('?', start) - start);
+
+	std::string result = method + " ";
+	std::string resource;
+	int index = -1; // of the segment after the version, -1 until then
+	size_t i = 0;
+	while (i < path.size()) {
+		size_t next = std::min(path.find('/', i + 1), path.size());
+		std::string segment = path.substr(i + 1, next - i - 1);
+		i = next;
+
+		bool is_id = !segment.empty() && std::all_of(segment.begin(), segment.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+		if (index == -1) {
+			bool is_version = segment.size() > 1 && segment[0] == 'v' && std::all_of(segment.begin() + 1, segment.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+			if (segment == "api" || is_version) {
+				continue;
+			}
+			index = 0;
+		}
+
+		if (index == 0) {
+			resource = segment;
+		}
+		// the id straight after channels, guilds or webhooks is a major parameter, which gets its own buckets
+		bool major = index == 1 && (resource == "channels" || resource == "guilds" || resource == "webhooks");
+		result += "/" + (is_id && !major ? ":id" : segment);
+		index++;
+	}
+
+	return result;
+}
+
+RateLimiter::Bucket &RateLimiter::bucket(const std::string &route) {
+	auto it = route_buckets.find(route);
+	return buckets[it == route_buckets.end() ? route : it->second];
+}
+
+RateLimiter::clock::time_point RateLimiter::reserve(const std::string &route) {
+	std::lock_guard<std::mutex> lock(mutex);
+	clock::time_point now = clock::now();
+
+	if (now < global_reset) {
+		delayed++;
+		return global_reset;
+	}
+	if (now - global_window >= std::chrono::seconds(1)) {
+		global_window = now;
+		global_used = 0;
+	}
+	if (global_used >= global_per_second) {
+		delayed++;
+		return global_window + std::chrono::seconds(1);
+	}
+
+	Bucket &b = bucket(route);
+	if (b.remaining <= 0) {
+		if (now < b.reset) {
+			delayed++;
+			return b.reset;
+		}
+		b.remaining = b.limit;
+		b.known = false;
+	}
+	if (!b.known) {
+		b.reset = now + std::chrono::milliseconds(unknown_reset_hold_ms);
+	}
+
+	b.remaining--;
+	global_used++;
+	return now;
+}
+
+std::chrono::milliseconds RateLimiter::update(const std::string &r, const HTTP::Response &response) {
+	std::lock_guard<std::mutex> lock(mutex);
+	clock::time_point now = clock::now();
+
+	auto header = [&response](const std::string &name) -> const std::string * {
+		auto it = response.headers.find(name);
+		return it == response.headers.end() ? nullptr : &it->second;
+	};
+	auto to_milliseconds = [](double seconds) {
+		return std::chrono::milliseconds(static_cast<long>(std::ceil(std::max(0.0, seconds) * 1000)));
+	};
+
+	const std::string *bucket_name = header("x-ratelimit-bucket");
+	if (bucket_name) {
+		// routes can share a bucket, but each major parameter still has its own
+		size_t major_start = r.find_first_of("0123456789");
+		std::string major = major_start == std::string::npos ? "" : r.substr(major_start, r.find('/', major_start) - major_start);
+		route_buckets[r] = *bucket_name + " " + major;
+	}
+	Bucket &b = bucket(r);
+
+	const std::string *remaining = header("x-ratelimit-remaining");
+	const std::string *limit = header("x-ratelimit-limit");
+	const std::string *reset_after = header("x-ratelimit-reset-after");
+	const std::string *reset = header("x-ratelimit-reset");
+	try {
+		if (remaining && (reset_after || reset)) {
+			double seconds;
+			if (reset_after) {
+				seconds = std::stod(*reset_after);
+			}
+			else { // unix seconds, so depends on the clocks agreeing
+				double unix_now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+				seconds = std::stod(*reset) - unix_now;
+			}
+
+			// responses to requests made together arrive in any order, and requests may have been made since, so
+			// within a window the lowest count is right
+			int reported = std::stoi(*remaining);
+			b.remaining = now < b.reset ? std::min(b.remaining, reported) : reported;
+			b.reset = now + to_milliseconds(seconds);
+			b.known = true;
+			if (limit) {
+				b.limit = std::max(1, std::stoi(*limit));
+			}
+		}
+		else if (!b.known) {
+			// no limits reported, so stop holding the route
+			b.remaining = std::max(b.remaining, 1);
+			b.reset = now;
+		}
+	}
+	catch (const std::exception &) {
+		// malformed header, the bucket is left as it was
+	}
+
+	if (response.code != 429) {
+		return std::chrono::milliseconds(0);
+	}
+
+	// retry_after is milliseconds as an integer before API v8, seconds as a float from v8
+	double seconds = 1;
+	bool global = header("x-ratelimit-global") != nullptr;
+	try {
+		json body = json::parse(response.body);
+		auto retry_after = body.find("retry_after");
+		if (retry_after != body.end() && retry_after->is_number()) {
+			seconds = retry_after->is_number_integer() ? retry_after->get<long>() / 1000.0 : retry_after->get<double>();
+		}
+		global = global || body.value("global", false);
+	}
+	catch (const std::exception &) {
+		const std::string *retry_after = header("retry-after");
+		if (retry_after) {
+			try {
+				seconds = std::stod(*retry_after);
+			}
+			catch (const std::exception &) {}
+		}
+	}
+
+	std::chrono::milliseconds wait = to_milliseconds(seconds);
+	if (global) {
+		global_reset = now + wait;
+		global_limited++;
+	}
+	else {
+		b.remaining = 0;
+		b.reset = now + wait;
+		limited++;
+	}
+	return wait;
+}
+
+std::string RateLimiter::stats_string() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return "\n**rest rate limits:** " + std::to_string(buckets.size()) + " bucket(s), " + std::to_string(delayed) + " hold(s), "
+		+ std::to_string(limited + global_limited) + " 429s (" + std::to_string(global_limited) + " global)";
+}
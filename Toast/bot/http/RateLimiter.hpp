@@ -0,0 +1,68 @@
+#ifndef BOT_HTTP_RATELIMITER
+#define BOT_HTTP_RATELIMITER
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "HTTP.hpp"
+
+/*
+* Discord's REST rate limits. Each route (method and path, with ids other than the channel, guild or webhook replaced)
+* belongs to a bucket, which allows `limit` requests until `reset`. Responses say which bucket a route is in and how
+* much of it is left (X-RateLimit-*), and a 429 says how long to wait, either for the bucket or (X-RateLimit-Global)
+* every request. A global limit of 50 requests a second is kept regardless.
+*
+* Until a route's first response its bucket is unknown, so only one request at a time is allowed on it. Likewise
+* when a bucket's window has passed it is refilled, but held until a response gives the new window's reset.
+*/
+class RateLimiter {
+public:
+	typedef std::chrono::steady_clock clock;
+
+	RateLimiter();
+
+	// When a request on the route can be made: now, in which case it is counted against the bucket, or the time to try again.
+	clock::time_point reserve(const std::string &route);
+	// Records the limits the response reports, for any response. For a 429, returns how long to wait before trying again.
+	std::chrono::milliseconds update(const std::string &route, const HTTP::Response &response);
+
+	std::string stats_string();
+
+	// e.g. "POST /channels/1234/messages", "DELETE /channels/1234/messages/:id"
+	static std::string route(const std::string &method, const std::string &url);
+
+private:
+	static const int global_per_second = 50;
+	// how long a bucket is held without a response giving its reset, in case none comes back
+	static const int unknown_reset_hold_ms = 5000;
+
+	struct Bucket {
+		Bucket() : limit(1), remaining(1), known(false) {}
+
+		int limit;
+		int remaining;
+		clock::time_point reset;
+		bool known; // reset is the server's, rather than a hold
+	};
+
+	// must hold mutex
+	Bucket &bucket(const std::string &route);
+
+	std::mutex mutex;
+	// <route, bucket id> once the route's bucket is known, it may be shared with other routes
+	std::unordered_map<std::string, std::string> route_buckets;
+	// <bucket id, bucket>, ids are routes until a response names the bucket
+	std::unordered_map<std::string, Bucket> buckets;
+
+	clock::time_point global_reset;
+	clock::time_point global_window;
+	int global_used;
+
+	unsigned long delayed;
+	unsigned long limited;
+	unsigned long global_limited;
+};
+
+#endif
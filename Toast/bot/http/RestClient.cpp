@@ -0,0 +1,404 @@
+#include "RestClient.hpp"
+
+#include "../Logger.hpp"
+
+RestClient::RestClient(HTTP::HandlePool &pool, size_t max_in_flight)
+	: pool(pool), max_in_flight(std::max<size_t>(1, max_in_flight)), work(new boost::asio::io_service::work(service)), timeout_timer(service) {
+	stopped = false;
+	outstanding = max_outstanding = 0;
+	submitted = failed = retried = connections = 0;
+	in_flight_count = 0;
+
+	multi = curl_multi_init();
+	curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, &RestClient::on_socket);
+	curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+	curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, &RestClient::on_timer);
+	curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+
+	thread = std::thread([this]() {
+		service.run();
+	});
+}
+
+RestClient::~RestClient() {
+	stop(std::chrono::milliseconds(0));
+}
+
+void RestClient::submit(HTTP::Request request, HTTP::Callback callback) {
+	std::shared_ptr<Transfer> transfer = std::make_shared<Transfer>();
+	transfer->request = std::move(request);
+	transfer->callback = std::move(callback);
+	transfer->route = RateLimiter::route(transfer->request.method, transfer->request.url);
+	transfer->attempts = 0;
+	transfer->rate_limited = 0;
+	transfer->submitted = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		if (stopped) {
+			Logger::write("[rest] Client stopped, dropped " + transfer->request.method + " " + transfer->request.url, Logger::LogLevel::Warning);
+			return;
+		}
+		submitted++;
+		outstanding++;
+		max_outstanding = std::max(max_outstanding, outstanding);
+	}
+
+	service.post([this, transfer]() {
+		enqueue(transfer);
+		start_transfers();
+	});
+}
+
+void RestClient::after(std::chrono::milliseconds delay, std::function<void()> fn) {
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		if (stopped) {
+			return;
+		}
+	}
+
+	service.post([this, delay, fn]() {
+		std::shared_ptr<boost::asio::steady_timer> timer = std::make_shared<boost::asio::steady_timer>(service, delay);
+		timers.insert(timer);
+
+		timer->async_wait([this, timer, fn](const boost::system::error_code &e) {
+			if (e) {
+				return; // cancelled by teardown
+			}
+			timers.erase(timer);
+			fn();
+		});
+	});
+}
+
+void RestClient::stop(std::chrono::milliseconds timeout) {
+	{
+		std::unique_lock<std::mutex> lock(stats_mutex);
+		if (stopped) {
+			return;
+		}
+		stopped = true;
+
+		if (!idle.wait_for(lock, timeout, [this]() { return outstanding == 0; })) {
+			Logger::write("[rest] Stopping with " + std::to_string(outstanding) + " request(s) unfinished", Logger::LogLevel::Warning);
+		}
+	}
+
+	// once the sockets and timers are let go of, nothing is left for the thread to do
+	service.post([this]() {
+		teardown();
+		work.reset();
+	});
+	thread.join();
+}
+
+void RestClient::teardown() {
+	for (auto &t : in_flight) {
+		curl_multi_remove_handle(multi, t.first);
+		pool.release(std::move(t.second->handle));
+	}
+	in_flight.clear();
+	ready.clear();
+	queues.clear();
+
+	for (auto &s : sockets) {
+		s.second->removed = true;
+		s.second->descriptor.release();
+	}
+	sockets.clear();
+
+	timeout_timer.cancel();
+	for (auto &timer : timers) {
+		timer->cancel();
+	}
+	timers.clear();
+	for (auto &l : limited) {
+		l.second.timer->cancel();
+	}
+	limited.clear();
+
+	curl_multi_cleanup(multi);
+	multi = nullptr;
+}
+
+void RestClient::enqueue(std::shared_ptr<Transfer> transfer) {
+	if (transfer->request.queue.empty()) {
+		ready.push_back(transfer);
+		return;
+	}
+
+	// only the front of a queue is ever ready
+	std::deque<std::shared_ptr<Transfer>> &queue = queues[transfer->request.queue];
+	queue.push_back(transfer);
+	if (queue.size() == 1) {
+		ready.push_back(transfer);
+	}
+}
+
+void RestClient::start_transfers() {
+	while (in_flight.size() < max_in_flight && !ready.empty()) {
+		std::shared_ptr<Transfer> transfer = ready.front();
+		ready.pop_front();
+
+		RateLimiter::clock::time_point when = limiter.reserve(transfer->route);
+		if (when > RateLimiter::clock::now()) {
+			hold(transfer, when);
+			continue;
+		}
+
+		transfer->handle = pool.acquire();
+		if (!transfer->handle) {
+			HTTP::Response response;
+			response.error = "couldn't create a curl handle";
+			complete(*transfer, response);
+			continue;
+		}
+
+		transfer->response = HTTP::Response();
+		transfer->handle->prepare(transfer->request, &transfer->response);
+		transfer->attempts++;
+
+		CURL *easy = transfer->handle->curl;
+		in_flight[easy] = transfer;
+		in_flight_count = in_flight.size();
+		curl_multi_add_handle(multi, easy);
+	}
+}
+
+void RestClient::check_finished() {
+	int messages_left;
+	CURLMsg *message;
+	while ((message = curl_multi_info_read(multi, &messages_left))) {
+		if (message->msg != CURLMSG_DONE) {
+			continue;
+		}
+		// message is freed by remove_handle
+		CURL *easy = message->easy_handle;
+		CURLcode result = message->data.result;
+
+		auto it = in_flight.find(easy);
+		std::shared_ptr<Transfer> transfer = it->second;
+		in_flight.erase(it);
+		in_flight_count = in_flight.size();
+
+		curl_multi_remove_handle(multi, easy);
+		finished(transfer, result);
+	}
+
+	start_transfers();
+}
+
+void RestClient::finished(std::shared_ptr<Transfer> transfer, CURLcode result) {
+	CURL *easy = transfer->handle->curl;
+
+	HTTP::Response response = std::move(transfer->response);
+	if (result == CURLE_OK) {
+		curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response.code);
+	}
+	else {
+		response.error = curl_easy_strerror(result);
+	}
+
+	long new_connections = 0;
+	curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &new_connections);
+	pool.release(std::move(transfer->handle));
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		connections += new_connections;
+	}
+
+	// whatever the response says about the limits, the transfers held back on the route get to try again
+	std::chrono::milliseconds wait = limiter.update(transfer->route, response);
+	wake(transfer->route);
+	if (response.code == 429 && transfer->rate_limited < max_rate_limited) {
+		Logger::write("[rest] Rate limited on " + transfer->route + ", trying again in " + std::to_string(wait.count()) + "ms", Logger::LogLevel::Debug);
+		transfer->rate_limited++;
+		transfer->attempts--;
+		ready.push_front(transfer);
+		return;
+	}
+
+	bool retryable = response.code == 0 || response.code >= 500;
+	if (retryable && transfer->attempts <= transfer->request.retries) {
+		Logger::write("[rest] " + transfer->request.method + " " + transfer->request.url + " failed ("
+			+ (response.code ? std::to_string(response.code) : response.error) + "), retrying", Logger::LogLevel::Warning);
+		{
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			retried++;
+		}
+		start_at(transfer, RateLimiter::clock::now() + std::chrono::milliseconds(100 * transfer->attempts));
+		return;
+	}
+
+	complete(*transfer, response);
+}
+
+void RestClient::start_at(std::shared_ptr<Transfer> transfer, RateLimiter::clock::time_point when) {
+	std::shared_ptr<boost::asio::steady_timer> timer = std::make_shared<boost::asio::steady_timer>(service, when);
+	timers.insert(timer);
+
+	timer->async_wait([this, timer, transfer](const boost::system::error_code &e) {
+		if (e) {
+			return; // cancelled by teardown
+		}
+		timers.erase(timer);
+
+		// still the front of its queue, so goes ahead of everything else
+		ready.push_front(transfer);
+		start_transfers();
+	});
+}
+
+void RestClient::hold(std::shared_ptr<Transfer> transfer, RateLimiter::clock::time_point when) {
+	Limited &l = limited[transfer->route];
+	l.transfers.push_back(transfer);
+	if (l.timer && l.timer->expiry() <= when) {
+		return;
+	}
+
+	if (l.timer) {
+		l.timer->cancel();
+	}
+	l.timer = std::make_shared<boost::asio::steady_timer>(service, when);
+	std::string route = transfer->route;
+	l.timer->async_wait([this, route](const boost::system::error_code &e) {
+		if (e) {
+			return; // replaced by an earlier time, woken or cancelled by teardown
+		}
+		wake(route);
+		start_transfers();
+	});
+}
+
+void RestClient::wake(const std::string &route) {
+	auto it = limited.find(route);
+	if (it == limited.end()) {
+		return;
+	}
+
+	// any still held back by the limit just wait again
+	it->second.timer->cancel();
+	ready.insert(ready.begin(), it->second.transfers.begin(), it->second.transfers.end());
+	limited.erase(it);
+}
+
+void RestClient::complete(Transfer &transfer, const HTTP::Response &response) {
+	if (transfer.callback) {
+		try {
+			transfer.callback(response);
+		}
+		catch (const std::exception &e) {
+			Logger::write("[rest] Callback for " + transfer.request.method + " " + transfer.request.url + " threw: " + e.what(), Logger::LogLevel::Severe);
+		}
+	}
+
+	if (!transfer.request.queue.empty()) {
+		auto it = queues.find(transfer.request.queue);
+		it->second.pop_front();
+		if (it->second.empty()) {
+			queues.erase(it);
+		}
+		else {
+			ready.push_back(it->second.front());
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	long took = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - transfer.submitted).count();
+	latency.record(took);
+	if (response.code < 200 || response.code >= 300) {
+		failed++;
+	}
+	if (--outstanding == 0) {
+		idle.notify_all();
+	}
+}
+
+int RestClient::on_socket(CURL *, curl_socket_t s, int what, void *client, void *) {
+	RestClient *self = static_cast<RestClient *>(client);
+
+	auto it = self->sockets.find(s);
+	if (what == CURL_POLL_REMOVE) {
+		if (it != self->sockets.end()) {
+			it->second->removed = true;
+			it->second->descriptor.release(); // cancels its waits
+			self->sockets.erase(it);
+		}
+		return 0;
+	}
+
+	if (it == self->sockets.end()) {
+		it = self->sockets.emplace(s, std::make_shared<Socket>(self->service, s)).first;
+	}
+	it->second->what = what;
+	self->watch(s, it->second);
+	return 0;
+}
+
+int RestClient::on_timer(CURLM *, long timeout_ms, void *client) {
+	RestClient *self = static_cast<RestClient *>(client);
+
+	if (timeout_ms < 0) {
+		self->timeout_timer.cancel();
+		return 0;
+	}
+
+	// never acted on from inside curl's callback, even when the timeout is 0
+	self->timeout_timer.expires_from_now(std::chrono::milliseconds(timeout_ms));
+	self->timeout_timer.async_wait([self](const boost::system::error_code &e) {
+		if (!e) {
+			self->socket_action(CURL_SOCKET_TIMEOUT, 0);
+		}
+	});
+	return 0;
+}
+
+void RestClient::watch(curl_socket_t s, std::shared_ptr<Socket> socket) {
+	// a wait already running for something curl no longer wants just gives curl a spurious action, which it ignores
+	if ((socket->what & CURL_POLL_IN) && !socket->reading) {
+		socket->reading = true;
+		socket->descriptor.async_read_some(boost::asio::null_buffers(), [this, s, socket](const boost::system::error_code &e, size_t) {
+			socket->reading = false;
+			if (e || socket->removed) {
+				return;
+			}
+			socket_action(s, CURL_CSELECT_IN);
+			if (!socket->removed) {
+				watch(s, socket);
+			}
+		});
+	}
+	if ((socket->what & CURL_POLL_OUT) && !socket->writing) {
+		socket->writing = true;
+		socket->descriptor.async_write_some(boost::asio::null_buffers(), [this, s, socket](const boost::system::error_code &e, size_t) {
+			socket->writing = false;
+			if (e || socket->removed) {
+				return;
+			}
+			socket_action(s, CURL_CSELECT_OUT);
+			if (!socket->removed) {
+				watch(s, socket);
+			}
+		});
+	}
+}
+
+void RestClient::socket_action(curl_socket_t s, int action) {
+	if (!multi) {
+		return;
+	}
+
+	int running;
+	curl_multi_socket_action(multi, s, action, &running);
+	check_finished();
+}
+
+std::string RestClient::stats_string() {
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	return "\n**rest requests:** " + std::to_string(submitted) + " (" + std::to_string(failed) + " failed, " + std::to_string(retried) + " retries), "
+			+ std::to_string(in_flight_count) + "/" + std::to_string(max_in_flight) + " in flight, " + std::to_string(outstanding) + " unfinished (max " + std::to_string(max_outstanding) + ")"
+		+ "\n**rest latency:** " + latency.to_string("ms")
+		+ "\n**rest connections:** " + std::to_string(connections) + " opened, " + pool.stats_string()
+		+ limiter.stats_string();
+}
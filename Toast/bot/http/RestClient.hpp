@@ -0,0 +1,136 @@
+#ifndef BOT_HTTP_RESTCLIENT
+#define BOT_HTTP_RESTCLIENT
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+#include <curl/curl.h>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "HTTP.hpp"
+#include "HandlePool.hpp"
+#include "RateLimiter.hpp"
+#include "../LatencyHistogram.hpp"
+
+/*
+* Makes requests with a curl multi handle driven by its own io_service and thread, so they never block whoever
+* asked for them. curl tells the client which sockets to wait on and when to time out (on_socket, on_timer), the
+* io_service waits, and hands the sockets back to curl when they are ready.
+*
+* Requests are only started when the RateLimiter allows, otherwise they wait with the others on their route until it
+* will, or until a response on the route tells the RateLimiter more. A 429 puts the request back to wait for its
+* bucket, without using up one of its retries.
+*
+* Everything but submit, stop and stats_string runs on the client's thread, so needs no locking.
+*/
+class RestClient {
+public:
+	RestClient(HTTP::HandlePool &pool, size_t max_in_flight);
+	~RestClient();
+
+	void submit(HTTP::Request request, HTTP::Callback callback);
+	// runs fn on the client's thread after delay, unless the client is stopped first
+	void after(std::chrono::milliseconds delay, std::function<void()> fn);
+	// Waits up to timeout for everything submitted to finish, then stops the thread. What's left is dropped.
+	void stop(std::chrono::milliseconds timeout);
+
+	std::string stats_string();
+
+private:
+	struct Transfer {
+		HTTP::Request request;
+		HTTP::Callback callback;
+		std::unique_ptr<HTTP::Handle> handle;
+		HTTP::Response response;
+		std::string route; // RateLimiter::route
+		int attempts;
+		int rate_limited;
+		std::chrono::steady_clock::time_point submitted;
+	};
+
+	// transfers held back by their route's rate limit
+	struct Limited {
+		std::deque<std::shared_ptr<Transfer>> transfers;
+		std::shared_ptr<boost::asio::steady_timer> timer; // for the earliest time one may start
+	};
+
+	// a socket curl has asked to be told about. The descriptor is released, never closed, as curl owns the socket.
+	struct Socket {
+		Socket(boost::asio::io_service &service, curl_socket_t s) : descriptor(service, s), what(0), reading(false), writing(false), removed(false) {}
+
+		boost::asio::posix::stream_descriptor descriptor;
+		int what; // CURL_POLL_*
+		bool reading;
+		bool writing;
+		bool removed;
+	};
+
+	void enqueue(std::shared_ptr<Transfer> transfer);
+	// starts ready transfers until max_in_flight are running
+	void start_transfers();
+	void check_finished();
+	void finished(std::shared_ptr<Transfer> transfer, CURLcode result);
+	void complete(Transfer &transfer, const HTTP::Response &response);
+	// puts the transfer back in front of the ready ones at the given time
+	void start_at(std::shared_ptr<Transfer> transfer, RateLimiter::clock::time_point when);
+	// holds the transfer back with the others on its route, until when at the latest
+	void hold(std::shared_ptr<Transfer> transfer, RateLimiter::clock::time_point when);
+	// puts the route's held back transfers in front of the ready ones
+	void wake(const std::string &route);
+	void teardown();
+
+	static int on_socket(CURL *easy, curl_socket_t s, int what, void *client, void *socket);
+	static int on_timer(CURLM *multi, long timeout_ms, void *client);
+	void watch(curl_socket_t s, std::shared_ptr<Socket> socket);
+	void socket_action(curl_socket_t s, int action);
+
+	// 429s a request can get before it is given up on
+	static const int max_rate_limited = 10;
+
+	HTTP::HandlePool &pool;
+	const size_t max_in_flight;
+	RateLimiter limiter;
+
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	std::thread thread;
+	CURLM *multi;
+	boost::asio::steady_timer timeout_timer;
+	// for transfers waiting to retry, and after()
+	std::unordered_set<std::shared_ptr<boost::asio::steady_timer>> timers;
+
+	// transfers to start as soon as there's room, in order
+	std::deque<std::shared_ptr<Transfer>> ready;
+	// <queue, transfers>, the front of each is in flight, ready or waiting to retry and the rest wait for it
+	std::unordered_map<std::string, std::deque<std::shared_ptr<Transfer>>> queues;
+	// <route, transfers>
+	std::unordered_map<std::string, Limited> limited;
+	std::unordered_map<CURL *, std::shared_ptr<Transfer>> in_flight;
+	std::unordered_map<curl_socket_t, std::shared_ptr<Socket>> sockets;
+
+	std::mutex stats_mutex;
+	std::condition_variable idle;
+	bool stopped;
+	// submitted but not yet complete
+	size_t outstanding;
+	size_t max_outstanding;
+	unsigned long submitted;
+	unsigned long failed;
+	unsigned long retried;
+	unsigned long connections;
+	std::atomic<size_t> in_flight_count;
+	// from submit to the callback, ms
+	LatencyHistogram latency;
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <mutex>
 
 #include <sqlite3.h>
 
@@ -9,6 +10,8 @@
 
 namespace CommandHelper {
 	std::vector<Command> commands;
+	// commands is shared by every shard's thread
+	std::mutex commands_mutex;
 
 	void init() {
 		sqlite3 *db; int return_code;
@@ -53,6 +56,8 @@ namespace CommandHelper {
 	}
 
 	bool get_command(std::string guild_id, std::string command_name, Command &command) {
+		std::lock_guard<std::mutex> lock(commands_mutex);
+
 		auto check_lambda = [guild_id, command_name](const Command &c) {
 			return guild_id == c.guild_id && command_name == c.command_name;
 		};
@@ -111,6 +116,8 @@ namespace CommandHelper {
 		sqlite3_close(db);
 
 		if (success) {
+			std::lock_guard<std::mutex> lock(commands_mutex);
+
 			if (ret_value == 1) {
 				commands.push_back({ guild_id, command_name, script });
 			}
@@ -10,15 +10,9 @@
 
 using namespace v8;
 
-V8Instance::V8Instance(BotConfig &c, std::string guild_id, std::map<std::string, DiscordObjects::Guild> *guilds, std::map<std::string, DiscordObjects::Channel> *channels,
-	std::map<std::string, DiscordObjects::User> *users, std::map<std::string, DiscordObjects::Role> *roles) : config(c) {
-
+V8Instance::V8Instance(BotConfig &c, std::string guild_id) : config(c), heap_total_bytes(0), heap_used_bytes(0) {
 	rng = std::mt19937(std::random_device()());
 	this->guild_id = guild_id;
-	this->guilds = guilds;
-	this->channels = channels;
-	this->users = users;
-	this->roles = roles;
 
 	create();
 }
@@ -28,34 +22,50 @@ void V8Instance::create() {
 	create_params.array_buffer_allocator = ArrayBuffer::Allocator::NewDefaultAllocator();
 
 	isolate = Isolate::New(create_params);
-	isolate->Enter();
 	Logger::write("[v8] Created isolate", Logger::LogLevel::Debug);
 
+	// the instance is used by whichever pipeline worker runs its guild's events, so the isolate is locked rather than entered for good
+	Locker locker(isolate);
 	Isolate::Scope isolate_scope(isolate);
 	HandleScope handle_scope(isolate);
 
 	// set global context
 	Local<Context> context = create_context();
 	context_.Reset(isolate, context);
-	Context::Scope context_scope(context);
+	update_heap_stats();
 
-	initialise(context);
+	Logger::write("[v8] Created context", Logger::LogLevel::Debug);
+}
 
-	Logger::write("[v8] Created context and context scope", Logger::LogLevel::Debug);
+void V8Instance::update_heap_stats() {
+	HeapStatistics stats;
+	isolate->GetHeapStatistics(&stats);
+	heap_total_bytes = stats.total_heap_size() + stats.malloced_memory();
+	heap_used_bytes = stats.used_heap_size();
 }
 
-void V8Instance::initialise(Local<Context> context) {
-	HandleScope handle_scope(isolate);
+Local<Object> V8Instance::wrap(Local<ObjectTemplate> templ, void *object, const std::shared_ptr<GuildView> &view) {
+	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
 
-	Local<Object> server_obj = wrap_server(&(*guilds)[guild_id]);
+	Wrapped *wrapped = new Wrapped;
+	wrapped->view = view;
+	wrapped->handle.Reset(isolate, result);
+	wrapped->handle.SetWeak(wrapped, V8Instance::on_wrapped_collected, WeakCallbackType::kParameter);
 
-	context->Global()->Set(
-		context,
-		String::NewFromUtf8(isolate, "server", NewStringType::kNormal).ToLocalChecked(),
-		server_obj
-	).FromJust();
+	result->SetInternalField(0, External::New(isolate, object));
+	result->SetInternalField(1, External::New(isolate, wrapped));
+
+	return result;
+}
+
+const std::shared_ptr<GuildView> &V8Instance::view_of(Local<Object> holder) {
+	return static_cast<Wrapped *>(holder->GetInternalField(1).As<External>()->Value())->view;
+}
 
-	Logger::write("[v8] Bound server template", Logger::LogLevel::Debug);
+void V8Instance::on_wrapped_collected(const WeakCallbackInfo<Wrapped> &info) {
+	Wrapped *wrapped = info.GetParameter();
+	wrapped->handle.Reset();
+	delete wrapped; // may free the view
 }
 
 v8::Local<v8::Context> V8Instance::create_context() {
@@ -85,7 +95,7 @@ Local<ObjectTemplate> V8Instance::make_server_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		NamedPropertyHandlerConfiguration(
 			V8Instance::js_get_server,
@@ -100,7 +110,7 @@ Local<ObjectTemplate> V8Instance::make_server_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_server(DiscordObjects::Guild *guild) {
+Local<Object> V8Instance::wrap_server(DiscordObjects::Guild *guild, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (server_template.IsEmpty()) {
@@ -109,10 +119,7 @@ Local<Object> V8Instance::wrap_server(DiscordObjects::Guild *guild) {
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, server_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
-
-	Local<External> guild_ptr = External::New(isolate, guild);
-	result->SetInternalField(0, guild_ptr);
+	Local<Object> result = wrap(templ, guild, view);
 
 	return handle_scope.Escape(result);
 }
@@ -138,7 +145,7 @@ void V8Instance::js_get_server(Local<Name> property, const PropertyCallbackInfo<
 	std::string property_s = *String::Utf8Value(property);
 
 	if (property_s == "Id") {
-		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), guild->id.c_str(), NewStringType::kNormal).ToLocalChecked());
+		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), guild->id.str().c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Name") {
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), guild->name.c_str(), NewStringType::kNormal).ToLocalChecked());
@@ -148,23 +155,24 @@ void V8Instance::js_get_server(Local<Name> property, const PropertyCallbackInfo<
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), icon_url.c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Owner") {
-		std::string owner_id = guild->owner_id;
-		DiscordObjects::GuildMember *owner = *std::find_if(guild->members.begin(), guild->members.end(), [owner_id](DiscordObjects::GuildMember *m) {
-			return owner_id == m->user->id;
-		});
-		Local<Object> owner_obj = self->wrap_user(owner);
+		DiscordObjects::GuildMember *owner = guild->find_member(guild->owner_id);
+		if (!owner) { // not loaded yet in a large guild
+			info.GetReturnValue().SetNull();
+			return;
+		}
+		Local<Object> owner_obj = self->wrap_user(owner, view_of(info.Holder()));
 		info.GetReturnValue().Set(owner_obj);
 	}
 	else if (property_s == "Roles") {
-		Local<Object> roles_obj = self->wrap_role_list(&guild->roles);
+		Local<Object> roles_obj = self->wrap_role_list(&guild->roles, view_of(info.Holder()));
 		info.GetReturnValue().Set(roles_obj);
 	}
 	else if (property_s == "Channels") {
-		Local<Object> channels_obj = self->wrap_channel_list(&guild->channels);
+		Local<Object> channels_obj = self->wrap_channel_list(&guild->channels, view_of(info.Holder()));
 		info.GetReturnValue().Set(channels_obj);
 	}
 	else if (property_s == "Users") {
-		Local<Object> users_obj = self->wrap_user_list(&guild->members);
+		Local<Object> users_obj = self->wrap_user_list(&guild->members, view_of(info.Holder()));
 		info.GetReturnValue().Set(users_obj);
 	}
 }
@@ -175,7 +183,7 @@ Local<ObjectTemplate> V8Instance::make_channel_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		NamedPropertyHandlerConfiguration(
 			V8Instance::js_get_channel,
@@ -190,7 +198,7 @@ Local<ObjectTemplate> V8Instance::make_channel_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_channel(DiscordObjects::Channel *channel) {
+Local<Object> V8Instance::wrap_channel(DiscordObjects::Channel *channel, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (role_template.IsEmpty()) {
@@ -199,10 +207,7 @@ Local<Object> V8Instance::wrap_channel(DiscordObjects::Channel *channel) {
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, channel_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
-
-	Local<External> channel_ptr = External::New(isolate, channel);
-	result->SetInternalField(0, channel_ptr);
+	Local<Object> result = wrap(templ, channel, view);
 
 	return handle_scope.Escape(result);
 }
@@ -221,7 +226,7 @@ void V8Instance::js_get_channel(Local<Name> property, const PropertyCallbackInfo
 	std::string property_s = *String::Utf8Value(property);
 
 	if (property_s == "Id") {
-		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), channel->id.c_str(), NewStringType::kNormal).ToLocalChecked());
+		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), channel->id.str().c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Name") {
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), channel->name.c_str(), NewStringType::kNormal).ToLocalChecked());
@@ -230,7 +235,7 @@ void V8Instance::js_get_channel(Local<Name> property, const PropertyCallbackInfo
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), channel->topic.c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "IsVoice") {
-		info.GetReturnValue().Set(Boolean::New(info.GetIsolate(), channel->type == "voice"));
+		info.GetReturnValue().Set(Boolean::New(info.GetIsolate(), channel->type == DiscordObjects::Channel::Type::Voice));
 	}
 	else if (property_s == "Users") {
 		info.GetIsolate()->ThrowException(String::NewFromUtf8(info.GetIsolate(), "Channel.Users not implemented.", NewStringType::kNormal).ToLocalChecked());
@@ -242,7 +247,7 @@ Local<ObjectTemplate> V8Instance::make_channel_list_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		IndexedPropertyHandlerConfiguration(
 			V8Instance::js_get_channel_list,
@@ -257,7 +262,7 @@ Local<ObjectTemplate> V8Instance::make_channel_list_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_channel_list(std::vector<DiscordObjects::Channel *> *channel_list) {
+Local<Object> V8Instance::wrap_channel_list(std::vector<DiscordObjects::Channel *> *channel_list, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (channel_list_template.IsEmpty()) {
@@ -266,15 +271,12 @@ Local<Object> V8Instance::wrap_channel_list(std::vector<DiscordObjects::Channel
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, channel_list_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
+	Local<Object> result = wrap(templ, channel_list, view);
 
 	// imitate an array
 	result->Set(String::NewFromUtf8(isolate, "length", NewStringType::kNormal).ToLocalChecked(), Integer::New(isolate, (*channel_list).size()));
 	result->SetPrototype(Array::New(isolate)->GetPrototype());
 
-	Local<External> channel_list_ptr = External::New(isolate, channel_list);
-	result->SetInternalField(0, channel_list_ptr);
-
 	return handle_scope.Escape(result);
 }
 
@@ -295,7 +297,7 @@ void V8Instance::js_get_channel_list(uint32_t index, const PropertyCallbackInfo<
 
 
 	if (index < (*channel_list).size()) {
-		Local<Object> channel_obj = self->wrap_channel((*channel_list)[index]);
+		Local<Object> channel_obj = self->wrap_channel((*channel_list)[index], view_of(info.Holder()));
 		info.GetReturnValue().Set(channel_obj);
 	}
 	else {
@@ -309,7 +311,7 @@ Local<ObjectTemplate> V8Instance::make_user_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		NamedPropertyHandlerConfiguration(
 			V8Instance::js_get_user,
@@ -324,7 +326,7 @@ Local<ObjectTemplate> V8Instance::make_user_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_user(DiscordObjects::GuildMember *member) {
+Local<Object> V8Instance::wrap_user(DiscordObjects::GuildMember *member, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (user_template.IsEmpty()) {
@@ -333,10 +335,7 @@ Local<Object> V8Instance::wrap_user(DiscordObjects::GuildMember *member) {
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, user_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
-
-	Local<External> member_ptr = External::New(isolate, member);
-	result->SetInternalField(0, member_ptr);
+	Local<Object> result = wrap(templ, member, view);
 
 	return handle_scope.Escape(result);
 }
@@ -362,10 +361,10 @@ void V8Instance::js_get_user(Local<Name> property, const PropertyCallbackInfo<Va
 	std::string property_s = *String::Utf8Value(property);
 
 	if (property_s == "Id") {
-		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), member->user->id.c_str(), NewStringType::kNormal).ToLocalChecked());
+		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), member->user->id.str().c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Name") {
-		std::string name = member->nick == "null" ? member->user->username : member->nick;
+		std::string name = member->nick == "null" ? member->user->username : member->nick.str();
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), name.c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "TrueName") { // ignores nick
@@ -377,15 +376,15 @@ void V8Instance::js_get_user(Local<Name> property, const PropertyCallbackInfo<Va
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), mention.c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "AvatarUrl") {
-		std::string avatar_url = "https://discordapp.com/api/users/" + member->user->id + "/avatars/" + member->user->avatar + ".jpg";
+		std::string avatar_url = "https://discordapp.com/api/users/" + member->user->id + "/avatars/" + member->user->avatar_string() + ".jpg";
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), avatar_url.c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Roles") {
-		Local<Object> roles_obj = self->wrap_role_list(&member->roles);
+		Local<Object> roles_obj = self->wrap_role_list(&member->roles, view_of(info.Holder()));
 		info.GetReturnValue().Set(roles_obj);
 	}
 	else if (property_s == "State") {
-		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), member->user->status.c_str(), NewStringType::kNormal).ToLocalChecked());
+		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), member->user->status_string().c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "CurrentGame") {
 		if (member->user->game == "null") {
@@ -401,7 +400,7 @@ Local<ObjectTemplate> V8Instance::make_user_list_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		IndexedPropertyHandlerConfiguration(
 			V8Instance::js_get_user_list,
@@ -416,7 +415,7 @@ Local<ObjectTemplate> V8Instance::make_user_list_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_user_list(std::vector<DiscordObjects::GuildMember *> *user_list) {
+Local<Object> V8Instance::wrap_user_list(std::vector<DiscordObjects::GuildMember *> *user_list, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (user_list_template.IsEmpty()) {
@@ -425,15 +424,12 @@ Local<Object> V8Instance::wrap_user_list(std::vector<DiscordObjects::GuildMember
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, user_list_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
+	Local<Object> result = wrap(templ, user_list, view);
 
 	// imitate an array
 	result->Set(String::NewFromUtf8(isolate, "length", NewStringType::kNormal).ToLocalChecked(), Integer::New(isolate, (*user_list).size()));
 	result->SetPrototype(Array::New(isolate)->GetPrototype());
 
-	Local<External> user_list_ptr = External::New(isolate, user_list);
-	result->SetInternalField(0, user_list_ptr);
-
 	return handle_scope.Escape(result);
 }
 
@@ -453,7 +449,7 @@ void V8Instance::js_get_user_list(uint32_t index, const PropertyCallbackInfo<Val
 	std::vector<DiscordObjects::GuildMember *> *user_list = static_cast<std::vector<DiscordObjects::GuildMember *> *>(user_list_v);
 
 	if (index < (*user_list).size()) {
-		Local<Object> role_obj = self->wrap_user((*user_list)[index]);
+		Local<Object> role_obj = self->wrap_user((*user_list)[index], view_of(info.Holder()));
 		info.GetReturnValue().Set(role_obj);
 	}
 	else {
@@ -467,7 +463,7 @@ Local<ObjectTemplate> V8Instance::make_role_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		NamedPropertyHandlerConfiguration(
 			V8Instance::js_get_role,
@@ -482,7 +478,7 @@ Local<ObjectTemplate> V8Instance::make_role_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_role(DiscordObjects::Role *role) {
+Local<Object> V8Instance::wrap_role(DiscordObjects::Role *role, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (role_template.IsEmpty()) {
@@ -491,10 +487,7 @@ Local<Object> V8Instance::wrap_role(DiscordObjects::Role *role) {
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, role_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
-
-	Local<External> role_ptr = External::New(isolate, role);
-	result->SetInternalField(0, role_ptr);
+	Local<Object> result = wrap(templ, role, view);
 
 	return handle_scope.Escape(result);
 }
@@ -513,7 +506,7 @@ void V8Instance::js_get_role(Local<Name> property, const PropertyCallbackInfo<Va
 	std::string property_s = *String::Utf8Value(property);
 
 	if (property_s == "Id") {
-		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), role->id.c_str(), NewStringType::kNormal).ToLocalChecked());
+		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), role->id.str().c_str(), NewStringType::kNormal).ToLocalChecked());
 	}
 	else if (property_s == "Name") {
 		info.GetReturnValue().Set(String::NewFromUtf8(info.GetIsolate(), role->name.c_str(), NewStringType::kNormal).ToLocalChecked());
@@ -531,7 +524,7 @@ Local<ObjectTemplate> V8Instance::make_role_list_template() {
 	EscapableHandleScope handle_scope(isolate);
 
 	Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
-	templ->SetInternalFieldCount(1);
+	templ->SetInternalFieldCount(2);
 	templ->SetHandler(
 		IndexedPropertyHandlerConfiguration(
 			V8Instance::js_get_role_list,
@@ -546,7 +539,7 @@ Local<ObjectTemplate> V8Instance::make_role_list_template() {
 	return handle_scope.Escape(templ);
 }
 
-Local<Object> V8Instance::wrap_role_list(std::vector<DiscordObjects::Role *> *role_list) {
+Local<Object> V8Instance::wrap_role_list(std::vector<DiscordObjects::Role *> *role_list, const std::shared_ptr<GuildView> &view) {
 	EscapableHandleScope handle_scope(isolate);
 
 	if (role_list_template.IsEmpty()) {
@@ -555,15 +548,12 @@ Local<Object> V8Instance::wrap_role_list(std::vector<DiscordObjects::Role *> *ro
 	}
 
 	Local<ObjectTemplate> templ = Local<ObjectTemplate>::New(isolate, role_list_template);
-	Local<Object> result = templ->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
+	Local<Object> result = wrap(templ, role_list, view);
 
 	// imitate an array
 	result->Set(String::NewFromUtf8(isolate, "length", NewStringType::kNormal).ToLocalChecked(), Integer::New(isolate, (*role_list).size()));
 	result->SetPrototype(Array::New(isolate)->GetPrototype());
 
-	Local<External> role_list_ptr = External::New(isolate, role_list);
-	result->SetInternalField(0, role_list_ptr);
-
 	return handle_scope.Escape(result);
 }
 
@@ -584,7 +574,7 @@ void V8Instance::js_get_role_list(uint32_t index, const PropertyCallbackInfo<Val
 
 
 	if (index < (*role_list).size()) {
-		Local<Object> role_obj = self->wrap_role((*role_list)[index]);
+		Local<Object> role_obj = self->wrap_role((*role_list)[index], view_of(info.Holder()));
 		info.GetReturnValue().Set(role_obj);
 	}
 	else {
@@ -664,7 +654,16 @@ void V8Instance::js_shuffle(const v8::FunctionCallbackInfo<v8::Value> &args) {
 	}
 }
 
-void V8Instance::exec_js(std::string js, DiscordObjects::Channel *channel, DiscordObjects::GuildMember *sender, std::string args) {
+void V8Instance::exec_js(std::shared_ptr<GuildView> view, std::string js, uint64_t channel_id, uint64_t sender_id, std::string args) {
+	DiscordObjects::Channel *channel = view->find_channel(channel_id);
+	DiscordObjects::GuildMember *sender = view->find_member(sender_id);
+	if (!channel || !sender) {
+		Logger::write("[v8] Channel " + std::to_string(channel_id) + " or member " + std::to_string(sender_id) + " missing from guild " + guild_id + "'s view", Logger::LogLevel::Warning);
+		return;
+	}
+
+	Locker locker(isolate);
+	Isolate::Scope isolate_scope(isolate);
 	HandleScope handle_scope(isolate);
 	Local<Context> context = Local<Context>::New(isolate, context_);
 	Context::Scope context_scope(context);
@@ -673,12 +672,18 @@ void V8Instance::exec_js(std::string js, DiscordObjects::Channel *channel, Disco
 		String::NewFromUtf8(isolate, "input", NewStringType::kNormal).ToLocalChecked(),
 		String::NewFromUtf8(isolate, args.c_str(), NewStringType::kNormal).ToLocalChecked()
 	);
-	Local<Object> user_obj = wrap_user(sender);
+	// rebound every run, to the latest view of the guild
+	Local<Object> server_obj = wrap_server(&view->guild, view);
+	context->Global()->Set(
+		String::NewFromUtf8(isolate, "server", NewStringType::kNormal).ToLocalChecked(),
+		server_obj
+	);
+	Local<Object> user_obj = wrap_user(sender, view);
 	context->Global()->Set(
 		String::NewFromUtf8(isolate, "user", NewStringType::kNormal).ToLocalChecked(),
 		user_obj
 	);
-	Local<Object> channel_obj = wrap_channel(channel);
+	Local<Object> channel_obj = wrap_channel(channel, view);
 	context->Global()->Set(
 		String::NewFromUtf8(isolate, "channel", NewStringType::kNormal).ToLocalChecked(),
 		channel_obj
@@ -688,7 +693,7 @@ void V8Instance::exec_js(std::string js, DiscordObjects::Channel *channel, Disco
 	current_sender = sender;
 	current_channel = channel;
 
-	Logger::write("[v8] Preparing JS (guild " + (*guilds)[guild_id].id + ", channel " + channel->id + ")", Logger::LogLevel::Debug);
+	Logger::write("[v8] Preparing JS (guild " + guild_id + ", channel " + channel->id + ")", Logger::LogLevel::Debug);
 
 	Local<String> source = String::NewFromUtf8(isolate, js.c_str(), NewStringType::kNormal).ToLocalChecked();
 
@@ -706,6 +711,7 @@ void V8Instance::exec_js(std::string js, DiscordObjects::Channel *channel, Disco
 		Logger::write("[v8] Compilation error: " + err_msg, Logger::LogLevel::Debug);
 		DiscordAPI::send_message(channel->id, ":warning: **Compilation error:** `" + err_msg + "`", config.token, config.cert_location);
 
+		update_heap_stats();
 		return;
 	}
 
@@ -722,6 +728,7 @@ void V8Instance::exec_js(std::string js, DiscordObjects::Channel *channel, Disco
 	auto end = std::chrono::steady_clock::now();
 	long long time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
 	Logger::write("[v8] Script compiled and run in " + std::to_string(time_taken) + "ms", Logger::LogLevel::Debug);
+	update_heap_stats();
 
 	current_sender = nullptr;
 	current_channel = nullptr;
@@ -2,6 +2,7 @@
 #define BOT_JS_V8INSTANCE
 
 #include <memory>
+#include <atomic>
 #include <map>
 #include <random>
 
@@ -13,14 +14,20 @@
 #include "../data_structures/Role.hpp"
 #include "../data_structures/GuildMember.hpp"
 #include "../data_structures/User.hpp"
+#include "../GuildView.hpp"
 
 class BotConfig;
 
 class V8Instance {
 public:
-	V8Instance(BotConfig &c, std::string guild_id, std::map<std::string, DiscordObjects::Guild> *guilds,
-		std::map<std::string, DiscordObjects::Channel> *channels, std::map<std::string, DiscordObjects::User> *users, std::map<std::string, DiscordObjects::Role> *roles);
-	void exec_js(std::string js, DiscordObjects::Channel *channel, DiscordObjects::GuildMember *sender, std::string args = "");
+	V8Instance(BotConfig &c, std::string guild_id);
+
+	// Runs against the view rather than the caches, so doesn't need cache_mutex. Does nothing if the channel or sender aren't in the view.
+	void exec_js(std::shared_ptr<GuildView> view, std::string js, uint64_t channel_id, uint64_t sender_id, std::string args = "");
+
+	// as of the last script run, so they can be read without locking the isolate
+	size_t heap_total() const { return heap_total_bytes; }
+	size_t heap_used() const { return heap_used_bytes; }
 
 private:
 	BotConfig &config;
@@ -28,46 +35,62 @@ private:
 	void create();
 	v8::Local<v8::Context> create_context();
 
-	void initialise(v8::Local<v8::Context> context);
+	// isolate must be locked
+	void update_heap_stats();
+	std::atomic<size_t> heap_total_bytes;
+	std::atomic<size_t> heap_used_bytes;
+
+	/*
+	* Wrapped objects point into a GuildView, which they keep alive until V8 collects them, as scripts can keep them in
+	* globals between runs. Internal field 0 is the object, 1 the Wrapped. Objects reached through another (e.g. a
+	* list's elements) share its view.
+	*/
+	struct Wrapped {
+		std::shared_ptr<GuildView> view;
+		v8::Global<v8::Object> handle;
+	};
+	v8::Local<v8::Object> wrap(v8::Local<v8::ObjectTemplate> templ, void *object, const std::shared_ptr<GuildView> &view);
+	static const std::shared_ptr<GuildView> &view_of(v8::Local<v8::Object> holder);
+	static void on_wrapped_collected(const v8::WeakCallbackInfo<Wrapped> &info);
 
 	/* server */
 	v8::Global<v8::ObjectTemplate> server_template;
 	v8::Local<v8::ObjectTemplate> make_server_template();
-	v8::Local<v8::Object> wrap_server(DiscordObjects::Guild *guild);
+	v8::Local<v8::Object> wrap_server(DiscordObjects::Guild *guild, const std::shared_ptr<GuildView> &view);
 	static void js_get_server(v8::Local<v8::Name> property, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 
 	/* user */
 	v8::Global<v8::ObjectTemplate> user_template;
 	v8::Local<v8::ObjectTemplate> make_user_template();
-	v8::Local<v8::Object> wrap_user(DiscordObjects::GuildMember *member);
+	v8::Local<v8::Object> wrap_user(DiscordObjects::GuildMember *member, const std::shared_ptr<GuildView> &view);
 	static void js_get_user(v8::Local<v8::Name> property, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	v8::Global<v8::ObjectTemplate> user_list_template;
 	v8::Local<v8::ObjectTemplate> make_user_list_template();
-	v8::Local<v8::Object> wrap_user_list(std::vector<DiscordObjects::GuildMember *> *user_list);
+	v8::Local<v8::Object> wrap_user_list(std::vector<DiscordObjects::GuildMember *> *user_list, const std::shared_ptr<GuildView> &view);
 	static void js_get_user_list(uint32_t index, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	/* channel */
 	v8::Global<v8::ObjectTemplate> channel_template;
 	v8::Local<v8::ObjectTemplate> make_channel_template();
-	v8::Local<v8::Object> wrap_channel(DiscordObjects::Channel *channel);
+	v8::Local<v8::Object> wrap_channel(DiscordObjects::Channel *channel, const std::shared_ptr<GuildView> &view);
 	static void js_get_channel(v8::Local<v8::Name> property, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	v8::Global<v8::ObjectTemplate> channel_list_template;
 	v8::Local<v8::ObjectTemplate> make_channel_list_template();
-	v8::Local<v8::Object> wrap_channel_list(std::vector<DiscordObjects::Channel *> *channel_list);
+	v8::Local<v8::Object> wrap_channel_list(std::vector<DiscordObjects::Channel *> *channel_list, const std::shared_ptr<GuildView> &view);
 	static void js_get_channel_list(uint32_t index, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	/* role */
 	v8::Global<v8::ObjectTemplate> role_template;
 	v8::Local<v8::ObjectTemplate> make_role_template();
-	v8::Local<v8::Object> wrap_role(DiscordObjects::Role *role);
+	v8::Local<v8::Object> wrap_role(DiscordObjects::Role *role, const std::shared_ptr<GuildView> &view);
 	static void js_get_role(v8::Local<v8::Name> property, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	v8::Global<v8::ObjectTemplate> role_list_template;
 	v8::Local<v8::ObjectTemplate> make_role_list_template();
-	v8::Local<v8::Object> wrap_role_list(std::vector<DiscordObjects::Role *> *role_list);
+	v8::Local<v8::Object> wrap_role_list(std::vector<DiscordObjects::Role *> *role_list, const std::shared_ptr<GuildView> &view);
 	static void js_get_role_list(uint32_t index, const v8::PropertyCallbackInfo<v8::Value> &info);
 
 	/* print function */
@@ -77,11 +100,6 @@ private:
 	static void js_random(const v8::FunctionCallbackInfo<v8::Value> &args);
 	static void js_shuffle(const v8::FunctionCallbackInfo<v8::Value> &args);
 
-	std::map<std::string, DiscordObjects::Guild> *guilds;
-	std::map<std::string, DiscordObjects::Channel> *channels;
-	std::map<std::string, DiscordObjects::User> *users;
-	std::map<std::string, DiscordObjects::Role> *roles;
-
 	std::string guild_id;
 	v8::Isolate *isolate;
 
@@ -7240,8 +7240,9 @@ class basic_json
         using lexer_char_t = unsigned char;
 
         /// constructor with a given buffer
+        /// (Toast: lexes s in place. m_buffer is only used when reading a stream, copying s into it was wasted.)
         explicit lexer(const string_t& s) noexcept
-            : m_stream(nullptr), m_buffer(s)
+            : m_stream(nullptr), m_buffer()
         {
             m_content = reinterpret_cast<const lexer_char_t*>(s.c_str());
             assert(m_content != nullptr);